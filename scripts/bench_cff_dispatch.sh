@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# Benchmark the CFF dispatchers against each other.
+#
+# Flattens each input with LLVM_OBF_CFF_DISPATCH=switch|indirect|threaded,
+# builds it with llc -O2, and reports the best-of-N wall time (plus branch
+# misses when `perf` is available) next to the unflattened baseline. Inputs
+# default to tests/cff_test.bc and the loop-heavy tests/cff_kernels.ll.
+#
+# Usage: scripts/bench_cff_dispatch.sh [runs] [input[:args] ...]
+set -e
+cd "$(dirname "$0")/.."
+
+RUNS="${1:-5}"; shift || true
+INPUTS=("$@")
+[ ${#INPUTS[@]} -gt 0 ] || INPUTS=("tests/cff_test.bc" "tests/cff_kernels.ll:300000")
+
+export PATH="/usr/lib/llvm-14/bin:$PATH"
+OPT=$(command -v opt-14 || command -v opt)
+LLC=$(command -v llc-14 || command -v llc)
+CC=${CC:-cc}
+PLUGIN=${PLUGIN:-build/libObfPasses.so}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+HAVE_PERF=0
+command -v perf >/dev/null 2>&1 && HAVE_PERF=1
+
+best_time() {  # best wall time in ms over $RUNS runs of "$@"
+  local best=""
+  for _ in $(seq "$RUNS"); do
+    local t0 t1 ms
+    t0=$(date +%s%N); "$@" >/dev/null; t1=$(date +%s%N)
+    ms=$(( (t1 - t0) / 1000000 ))
+    if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then best=$ms; fi
+  done
+  echo "$best"
+}
+
+printf "%-24s %-9s %10s %14s\n" input dispatch best-ms branch-misses
+for spec in "${INPUTS[@]}"; do
+  in="${spec%%:*}"; args=""
+  [ "$spec" != "$in" ] && args="${spec#*:}"
+  name=$(basename "$in")
+  "$OPT" "$in" -o "$WORK/base.bc"
+  for mode in none switch indirect threaded; do
+    if [ "$mode" = none ]; then
+      cp "$WORK/base.bc" "$WORK/$mode.bc"
+    else
+      LLVM_OBF_CFF_DISPATCH=$mode "$OPT" -load-pass-plugin="$PLUGIN" -passes=cff \
+        "$WORK/base.bc" -o "$WORK/$mode.bc"
+    fi
+    "$LLC" -O2 -relocation-model=pic -filetype=obj "$WORK/$mode.bc" -o "$WORK/$mode.o"
+    "$CC" "$WORK/$mode.o" -o "$WORK/$mode"
+    # shellcheck disable=SC2086
+    ms=$(best_time "$WORK/$mode" $args)
+    misses="n/a"
+    if [ "$HAVE_PERF" = 1 ]; then
+      # shellcheck disable=SC2086
+      misses=$(perf stat -x, -e branch-misses "$WORK/$mode" $args 2>&1 >/dev/null | awk -F, '/branch-misses/ { print $1 }')
+    fi
+    printf "%-24s %-9s %10s %14s\n" "$name" "$mode" "$ms" "$misses"
+  done
+done
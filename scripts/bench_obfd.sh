@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+# Per-TU cost of one `opt-14` process versus one obfc request to a running
+# obfd, for many small TUs.
+#
+# Obfuscates INPUT COUNT times with the same pipeline, first with a fresh opt
+# (process start, LLVM initialization, plugin load each time), then through
+# obfc with up to JOBS requests in flight. Reports wall time per TU for both
+# and the server's latency histograms, which show what is left once startup
+# is gone.
+#
+# Usage: scripts/bench_obfd.sh [count] [jobs] [input]
+set -e
+cd "$(dirname "$0")/.."
+
+COUNT="${1:-200}"
+JOBS="${2:-$(nproc)}"
+INPUT="${3:-tests/cff_test.bc}"
+PASSES="${PASSES:-string-obf,bogus-insert,fake-loop,cff}"
+
+BUILD=${BUILD:-build}
+PLUGIN="$PWD/$BUILD/libObfPasses.so"
+WORK=$(mktemp -d)
+SOCK="$WORK/obfd.sock"
+trap 'kill $SERVER 2> /dev/null || true; rm -rf "$WORK"' EXIT
+export LLVM_OBF_SEED=${LLVM_OBF_SEED:-1}
+
+per_tu() { awk -v s="$1" -v e="$2" -v n="$COUNT" 'BEGIN { printf "%.2f ms/TU", (e - s) / n / 1e6 }'; }
+
+start=$(date +%s%N)
+seq "$COUNT" | xargs -P "$JOBS" -I{} sh -c \
+  "opt-14 -load-pass-plugin='$PLUGIN' -passes='$PASSES' '$INPUT' -o '$WORK/opt{}.bc' 2> /dev/null"
+end=$(date +%s%N)
+echo "opt-14 per TU:  $(per_tu "$start" "$end")  ($COUNT TUs, $JOBS jobs)"
+
+"$BUILD/tools/obfd" --socket "$SOCK" --plugin "$PLUGIN" --jobs "$JOBS" --log /dev/null > /dev/null &
+SERVER=$!
+for _ in $(seq 100); do [ -S "$SOCK" ] && break; sleep 0.05; done
+
+start=$(date +%s%N)
+seq "$COUNT" | xargs -P "$JOBS" -I{} \
+  "$BUILD/tools/obfc" --socket "$SOCK" --passes "$PASSES" "$INPUT" -o "$WORK/obfd{}.bc"
+end=$(date +%s%N)
+echo "obfc per TU:    $(per_tu "$start" "$end")"
+
+"$BUILD/tools/obfc" --socket "$SOCK" --stats
+"$BUILD/tools/obfc" --socket "$SOCK" --shutdown
+wait "$SERVER"
@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+# Compare the CLI's in-process pass pipeline with the old opt-per-pass one.
+#
+# Runs build/tools/LLVM_OBFSCALTION.exe non-interactively on each input with
+# --pipeline inproc and --pipeline shell (same preset and seed, IR output so
+# nothing is linked) and reports the best-of-N pass time, end-to-end time and
+# process launches from the CLI's timing breakdown.
+#
+# Usage: scripts/bench_pipeline.sh [runs] [preset] [input ...]
+set -e
+cd "$(dirname "$0")/.."
+
+RUNS="${1:-5}"; shift || true
+PRESET="${1:-Heavy}"; shift || true
+INPUTS=("$@")
+[ ${#INPUTS[@]} -gt 0 ] || INPUTS=("tests/cff_test.bc" "tests/cff_kernels.ll")
+
+BUILD=${BUILD:-build}
+CLI="$PWD/$BUILD/tools/LLVM_OBFSCALTION.exe"
+PLUGIN="$PWD/$BUILD/libObfPasses.so"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# "Passes Total : P ms of T ms, N processes launched" -> "P T N"
+totals() {
+  sed 's/\x1b\[[0-9;]*m//g' | awk '/Passes Total/ { print $4, $7, $9 }'
+}
+
+printf "%-20s %-7s %12s %12s %10s\n" input mode passes-ms total-ms processes
+for in in "${INPUTS[@]}"; do
+  name=$(basename "$in")
+  for mode in shell inproc; do
+    best_p=""; best_t=""; procs=""
+    for _ in $(seq "$RUNS"); do
+      read -r p t n < <(cd "$WORK" && "$CLI" "$OLDPWD/$in" --pipeline "$mode" --preset "$PRESET" --seed 1 \
+        --plugin "$PLUGIN" --output out.ll | totals)
+      if [ -z "$best_t" ] || awk "BEGIN { exit !($t < $best_t) }"; then best_p=$p; best_t=$t; procs=$n; fi
+    done
+    printf "%-20s %-7s %12s %12s %10s\n" "$name" "$mode" "$best_p" "$best_t" "$procs"
+  done
+done
@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+# Run-time cost of obfuscation: wall time, code size and peak RSS of each
+# preset relative to the unobfuscated build.
+#
+# Every kernel in tests/bench_<kernel>.bc (built from the .c next to it with
+# `clang-14 -O2 -c -emit-llvm`) is compiled as-is for the baseline and, for
+# every preset and seed, run through the CLI first. Everything goes through
+# the same `llc-14 -O2` and is linked with the string decryption runtime. Each
+# build must print the same result as the baseline before it is timed.
+# Reported per build: median wall time over RUNS runs, text + data size of
+# the kernel's object as size(1) counts them (the runtime is left out) and
+# peak RSS, plus the ratio of each to the baseline. The summary takes the
+# median ratio over the seeds.
+#
+# Results are written as JSON to OUT (default: bench_runtime.json), with a
+# readable table on stdout. QUICK=1 runs tiny problem sizes, for smoke tests.
+#
+# Usage: scripts/bench_runtime.sh [runs] [seeds] [out.json]
+set -e
+cd "$(dirname "$0")/.."
+
+RUNS="${1:-5}"
+SEEDS="${2:-1 2 3}"
+OUT="${3:-bench_runtime.json}"
+KERNELS="${KERNELS:-strings branches numeric recursion}"
+PRESETS="${PRESETS:-Light Balanced Heavy Nightmare}"
+
+BUILD=$(cd "${BUILD:-build}" && pwd)
+CLI="$BUILD/tools/LLVM_OBFSCALTION.exe"
+PLUGIN="$BUILD/libObfPasses.so"
+MEASURE="$BUILD/tools/bench_measure"
+RUNTIME="$PWD/src/runtime/decryptor.c"
+CC=${CC:-cc}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Problem size per kernel; empty uses the kernel's own default (~0.1 s).
+args() {
+  [ "$QUICK" = 1 ] || return 0
+  case $1 in
+    strings|branches) echo 20000 ;;
+    numeric) echo 5 ;;
+    recursion) echo 20 ;;
+  esac
+}
+
+# bitcode -> executable, the same way for every build
+link() {
+  llc-14 -O2 -relocation-model=pic -filetype=obj "$1" -o "$2.o"
+  "$CC" -O2 "$2.o" "$RUNTIME" -lpthread -o "$2"
+}
+
+code_bytes() { size "$1" | awk 'NR == 2 { print $1 + $2 }'; }
+
+ratio() { awk -v a="$1" -v b="$2" 'BEGIN { printf "%.3f", b ? a / b : 0 }'; }
+
+median() { sort -g | awk '{ v[NR] = $1 } END { printf "%.3f", NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'; }
+
+ROWS="$WORK/rows"
+: > "$ROWS"
+printf "%-10s %-10s %5s %10s %7s %8s %7s %8s %7s\n" kernel preset seed time-ms x code-B x rss-KB x
+for kernel in $KERNELS; do
+  input="$PWD/tests/bench_$kernel.bc"
+  link "$input" "$WORK/$kernel.base"
+  expected=$("$WORK/$kernel.base" $(args "$kernel"))
+  read -r base_us _ _ base_rss < <("$MEASURE" "$RUNS" "$WORK/$kernel.base" $(args "$kernel"))
+  base_code=$(code_bytes "$WORK/$kernel.base.o")
+  echo "$kernel none 0 $base_us $base_code $base_rss 1.000 1.000 1.000" >> "$ROWS"
+  printf "%-10s %-10s %5s %10.1f %7s %8s %7s %8s %7s\n" "$kernel" none - "$(ratio "$base_us" 1000)" 1.000 "$base_code" 1.000 "$base_rss" 1.000
+
+  for preset in $PRESETS; do
+    for seed in $SEEDS; do
+      exe="$WORK/$kernel.$preset.$seed"
+      (cd "$WORK" && "$CLI" "$input" --preset "$preset" --seed "$seed" --plugin "$PLUGIN" --output "$exe.bc" > "$exe.log" 2>&1) ||
+        { echo "$kernel/$preset/$seed: obfuscation failed"; tail -5 "$exe.log"; exit 1; }
+      link "$exe.bc" "$exe"
+      actual=$("$exe" $(args "$kernel"))
+      if [ "$actual" != "$expected" ]; then
+        echo "$kernel/$preset/$seed: printed '$actual', expected '$expected'"
+        exit 1
+      fi
+      read -r us _ _ rss < <("$MEASURE" "$RUNS" "$exe" $(args "$kernel"))
+      code=$(code_bytes "$exe.o")
+      tx=$(ratio "$us" "$base_us"); cx=$(ratio "$code" "$base_code"); rx=$(ratio "$rss" "$base_rss")
+      echo "$kernel $preset $seed $us $code $rss $tx $cx $rx" >> "$ROWS"
+      printf "%-10s %-10s %5s %10.1f %7s %8s %7s %8s %7s\n" "$kernel" "$preset" "$seed" "$(ratio "$us" 1000)" "$tx" "$code" "$cx" "$rss" "$rx"
+    done
+  done
+done
+
+{
+  printf '{\n  "commit": "%s",\n  "date": "%s",\n  "host": "%s",\n  "cc": "%s",\n  "runs": %s,\n  "quick": %s,\n' \
+    "$(git rev-parse --short HEAD 2> /dev/null || echo unknown)" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -m)" \
+    "$("$CC" --version | head -1)" "$RUNS" "$([ "$QUICK" = 1 ] && echo true || echo false)"
+  echo '  "results": ['
+  awk '{ printf "%s    {\"kernel\": \"%s\", \"preset\": \"%s\", \"seed\": %s, \"median_us\": %s, \"code_bytes\": %s, \"peak_rss_kb\": %s, \"time_ratio\": %s, \"code_ratio\": %s, \"rss_ratio\": %s}",
+         (NR > 1 ? ",\n" : ""), $1, $2, $3, $4, $5, $6, $7, $8, $9 } END { print "" }' "$ROWS"
+  echo '  ],'
+  echo '  "summary": ['
+  first=1
+  for kernel in $KERNELS; do
+    for preset in $PRESETS; do
+      sel() { awk -v k="$kernel" -v p="$preset" -v c="$1" '$1 == k && $2 == p { print $c }' "$ROWS" | median; }
+      [ $first = 1 ] || echo ','
+      first=0
+      printf '    {"kernel": "%s", "preset": "%s", "time_ratio": %s, "code_ratio": %s, "rss_ratio": %s}' \
+        "$kernel" "$preset" "$(sel 7)" "$(sel 8)" "$(sel 9)"
+    done
+  done
+  printf '\n  ]\n}\n'
+} > "$OUT"
+echo "results: $OUT"
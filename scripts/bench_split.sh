@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+# Scaling of the CLI's --split mode from 1 to 64 threads on one large module.
+#
+# Generates a module with FUNCS small loop functions plus a main that sums
+# their results, obfuscates it without splitting and then with --split PARTS
+# at each thread count (same preset and seed). Reports the best-of-N time of
+# the passes (for --split: the parallel partition runs), the same plus
+# splitting and linking, the speedup over one thread and the md5 of the
+# output, which must be the same on every --split line. The last output is
+# linked and run against the unobfuscated module.
+#
+# Usage: scripts/bench_split.sh [runs] [preset] [funcs] [parts]
+set -e
+cd "$(dirname "$0")/.."
+
+RUNS="${1:-3}"
+PRESET="${2:-Nightmare}"
+FUNCS="${3:-2000}"
+PARTS="${4:-64}"
+THREADS="1 2 4 8 16 32 64"
+
+BUILD=${BUILD:-build}
+CLI="$PWD/$BUILD/tools/LLVM_OBFSCALTION.exe"
+PLUGIN="$PWD/$BUILD/libObfPasses.so"
+RUNTIME="$PWD/src/runtime/decryptor.c"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+awk -v n="$FUNCS" 'BEGIN {
+  print "@.fmt = private unnamed_addr constant [4 x i8] c\"%d\\0A\\00\""
+  print "declare i32 @printf(i8*, ...)"
+  for (k = 0; k < n; k++) {
+    printf "define i32 @f%d(i32 %%n) {\n", k
+    print  "entry:\n  br label %loop"
+    print  "loop:"
+    print  "  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]"
+    printf "  %%acc = phi i32 [ %d, %%entry ], [ %%acc.next, %%latch ]\n", k
+    print  "  %odd = and i32 %i, 1\n  %c = icmp eq i32 %odd, 0"
+    print  "  br i1 %c, label %even, label %oddb"
+    print  "even:\n  %a1 = mul i32 %acc, 31\n  %a2 = add i32 %a1, %i\n  br label %latch"
+    printf "oddb:\n  %%b1 = xor i32 %%acc, %d\n  %%b2 = sub i32 %%b1, %%i\n  br label %%latch\n", k * 7 + 3
+    print  "latch:"
+    print  "  %acc.next = phi i32 [ %a2, %even ], [ %b2, %oddb ]"
+    print  "  %i.next = add i32 %i, 1\n  %done = icmp sge i32 %i.next, %n"
+    print  "  br i1 %done, label %exit, label %loop"
+    print  "exit:\n  ret i32 %acc.next\n}"
+  }
+  print "define i32 @main() {\nentry:"
+  prev = "0"
+  for (k = 0; k < n; k++) {
+    printf "  %%r%d = call i32 @f%d(i32 10)\n  %%s%d = add i32 %s, %%r%d\n", k, k, k, prev, k
+    prev = "%s" k
+  }
+  print "  %p = getelementptr [4 x i8], [4 x i8]* @.fmt, i32 0, i32 0"
+  printf "  call i32 (i8*, ...) @printf(i8* %%p, i32 %s)\n  ret i32 0\n}\n", prev
+}' > "$WORK/big.ll"
+
+# "Passes Total : P ms of ..." and the split steps -> "passes passes+split+link"
+times() {
+  sed 's/\x1b\[[0-9;]*m//g' | awk '
+    /Passes Total/ { passes = $4 }
+    /Split module|Link partitions/ { extra += $(NF-1) }
+    END { print passes, passes + extra }'
+}
+
+printf "%-8s %12s %14s %9s  %s\n" threads passes-ms with-split-ms speedup output-md5
+read -r p _ < <(cd "$WORK" && "$CLI" big.ll --preset "$PRESET" --seed 1 --plugin "$PLUGIN" --output base.ll | times)
+printf "%-8s %12s %14s %9s  %s\n" unsplit "$p" "$p" - "$(md5sum < "$WORK/base.ll" | cut -c1-12)"
+base=""
+for t in $THREADS; do
+  best_r=""; best_p=""
+  for _ in $(seq "$RUNS"); do
+    read -r r p < <(cd "$WORK" && "$CLI" big.ll --preset "$PRESET" --seed 1 --plugin "$PLUGIN" \
+      --split "$PARTS" --jobs "$t" --output out.ll | times)
+    if [ -z "$best_r" ] || awk "BEGIN { exit !($r < $best_r) }"; then best_r=$r; best_p=$p; fi
+  done
+  [ -n "$base" ] || base=$best_r
+  printf "%-8s %12s %14s %8.2fx  %s\n" "$t" "$best_r" "$best_p" "$(awk "BEGIN { print $base / $best_r }")" \
+    "$(md5sum < "$WORK/out.ll" | cut -c1-12)"
+done
+
+llc-14 -relocation-model=pic -filetype=obj "$WORK/out.ll" -o "$WORK/out.o"
+gcc "$WORK/out.o" "$RUNTIME" -lpthread -o "$WORK/obf"
+llc-14 -relocation-model=pic -filetype=obj "$WORK/big.ll" -o "$WORK/big.o"
+gcc "$WORK/big.o" -o "$WORK/plain"
+if [ "$("$WORK/obf")" = "$("$WORK/plain")" ]; then echo "output matches the unobfuscated module"; else echo "OUTPUT DIFFERS"; exit 1; fi
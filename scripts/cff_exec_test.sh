@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+# Runs a program under lli-14 before and after `cff` with the given dispatcher
+# and state encoding, and fails unless both print the same thing.
+#
+# Usage: scripts/cff_exec_test.sh <build-dir> <input.ll|.bc> <dispatch> <encoding>
+set -e
+BUILD=$(cd "$1" && pwd)
+INPUT=$2
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+expected=$(lli-14 "$INPUT")
+LLVM_OBF_CFF_DISPATCH=$3 LLVM_OBF_CFF_STATE_ENCODING=$4 opt-14 -load-pass-plugin="$BUILD/libObfPasses.so" \
+  -passes=cff,verify "$INPUT" -o "$WORK/cff.bc" 2> "$WORK/cff.log"
+actual=$(lli-14 "$WORK/cff.bc")
+if [ "$actual" != "$expected" ]; then
+  echo "$(basename "$INPUT") with $3/$4 printed '$actual', expected '$expected'"
+  exit 1
+fi
+echo "$(basename "$INPUT") $3/$4 OK: $actual"
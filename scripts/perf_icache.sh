@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+# Compare i-cache behaviour of the junk-block layouts of bogus-insert.
+#
+# Builds the same input three times with LLVM_OBF_JUNK_LAYOUT=inline|cold|outline
+# (bogus-insert + fake-loop, then -O2), runs each binary under `perf stat`
+# and prints L1 i-cache misses, instructions and cycles side by side, plus the
+# object-file size of the hot .text and of .text.unlikely (the linker folds
+# .text.unlikely into one group inside the executable's .text).
+#
+# Usage: scripts/perf_icache.sh <input.c|input.ll|input.bc> [runs] [-- program args]
+set -e
+cd "$(dirname "$0")/.."
+
+IN="$1"; shift || true
+RUNS="${1:-5}"; shift || true
+[ "$1" = "--" ] && shift
+if [ -z "$IN" ]; then
+  echo "usage: $0 <input.c|input.ll|input.bc> [runs] [-- program args]" >&2
+  exit 1
+fi
+
+export PATH="/usr/lib/llvm-14/bin:$PATH"
+OPT=$(command -v opt-14 || command -v opt)
+LLC=$(command -v llc-14 || command -v llc)
+CC=${CC:-cc}
+PLUGIN=${PLUGIN:-build/libObfPasses.so}
+SEED=${LLVM_OBF_SEED:-12345}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+case "$IN" in
+  *.c) clang-14 -O2 -emit-llvm -c "$IN" -o "$WORK/in.bc"; IN="$WORK/in.bc" ;;
+esac
+
+HAVE_PERF=1
+command -v perf >/dev/null 2>&1 || HAVE_PERF=0
+[ "$HAVE_PERF" = 1 ] || echo "perf not found: reporting wall time only" >&2
+
+section_size() {
+  size -A "$1" | awk -v s="$2" '$1 == s { print $2 }'
+}
+
+printf "%-8s %12s %14s %14s %10s %10s\n" layout icache-miss instructions cycles .text .unlikely
+for layout in inline cold outline; do
+  LLVM_OBF_SEED=$SEED LLVM_OBF_JUNK_LAYOUT=$layout \
+    "$OPT" -load-pass-plugin="$PLUGIN" -passes='bogus-insert,fake-loop,default<O2>' \
+    "$IN" -o "$WORK/$layout.bc" 2>/dev/null
+  "$LLC" -O2 -relocation-model=pic -filetype=obj "$WORK/$layout.bc" -o "$WORK/$layout.o"
+  "$CC" -O2 "$WORK/$layout.o" src/runtime/decryptor.c -o "$WORK/$layout" -lpthread
+
+  text=$(section_size "$WORK/$layout.o" .text)
+  cold=$(section_size "$WORK/$layout.o" .text.unlikely)
+  if [ "$HAVE_PERF" = 1 ]; then
+    perf stat -x, -r "$RUNS" -e L1-icache-load-misses,instructions,cycles \
+      -o "$WORK/$layout.perf" "$WORK/$layout" "$@" >/dev/null
+    miss=$(awk -F, '/L1-icache-load-misses/ { print $1 }' "$WORK/$layout.perf")
+    insn=$(awk -F, '/instructions/ { print $1 }' "$WORK/$layout.perf")
+    cyc=$(awk -F, '/cycles/ { print $1 }' "$WORK/$layout.perf")
+  else
+    start=$(date +%s%N)
+    for _ in $(seq "$RUNS"); do "$WORK/$layout" "$@" >/dev/null; done
+    miss="n/a"; insn="n/a"; cyc="$(( ($(date +%s%N) - start) / RUNS ))ns"
+  fi
+  printf "%-8s %12s %14s %14s %10s %10s\n" "$layout" "$miss" "$insn" "$cyc" "${text:-0}" "${cold:-0}"
+done
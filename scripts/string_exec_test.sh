@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+# Links a program with the string decryption runtime before and after
+# `string-obf` and fails unless both print the same thing. The pass takes its
+# settings (LLVM_OBF_STRING_*) from the environment. Each key=value argument
+# must then appear as "key": value in the pass's OFILE counters. With
+# LLVM_OBF_STRING_POOL=1 the object must also have fewer relocations than
+# the same settings give without pooling.
+#
+# Usage: scripts/string_exec_test.sh <build-dir> <input.ll|.bc> [key=value ...]
+set -e
+BUILD=$(cd "$1" && pwd)
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+INPUT=$2
+shift 2
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# bitcode -> executable, as scripts/bench_runtime.sh does
+link() {
+  llc-14 -O2 -relocation-model=pic -filetype=obj "$1" -o "$2.o"
+  "${CC:-cc}" "$2.o" "$ROOT/src/runtime/decryptor.c" -lpthread -o "$2"
+}
+
+link "$INPUT" "$WORK/base"
+expected=$("$WORK/base")
+OFILE="$WORK/stats.json" opt-14 -load-pass-plugin="$BUILD/libObfPasses.so" \
+  -passes=string-obf,verify "$INPUT" -o "$WORK/obf.bc" 2> "$WORK/obf.log"
+link "$WORK/obf.bc" "$WORK/obf"
+actual=$("$WORK/obf")
+if [ "$actual" != "$expected" ]; then
+  echo "$(basename "$INPUT") printed '$actual', expected '$expected'"
+  exit 1
+fi
+
+for check in "$@"; do
+  if ! grep -q "\"${check%%=*}\": ${check#*=},\?$" "$WORK/stats.json"; then
+    echo "$(basename "$INPUT"): expected ${check%%=*} = ${check#*=}"
+    cat "$WORK/stats.json"
+    exit 1
+  fi
+done
+
+relocs() { readelf -rW "$1" | grep -c '^[0-9a-f]\+ ' || true; }
+if [ "$LLVM_OBF_STRING_POOL" = 1 ]; then
+  LLVM_OBF_STRING_POOL=0 opt-14 -load-pass-plugin="$BUILD/libObfPasses.so" \
+    -passes=string-obf "$INPUT" -o "$WORK/flat.bc" 2> /dev/null
+  llc-14 -O2 -relocation-model=pic -filetype=obj "$WORK/flat.bc" -o "$WORK/flat.o"
+  pooled=$(relocs "$WORK/obf.o")
+  flat=$(relocs "$WORK/flat.o")
+  if [ "$pooled" -ge "$flat" ]; then
+    echo "$(basename "$INPUT"): $pooled relocations pooled, $flat without pooling"
+    exit 1
+  fi
+fi
+echo "$(basename "$INPUT") OK: $actual"
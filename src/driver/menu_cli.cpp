@@ -21,6 +21,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#ifdef __linux__
+#include <elf.h>
+#endif
 
 namespace myfs {
     using path = std::string;
@@ -98,6 +101,36 @@ static bool run_cmd(const std::string &cmd) {
     return rc == 0;
 }
 
+static long long file_size(const std::string &p) {
+    struct stat st;
+    if (stat(p.c_str(), &st) != 0) return -1;
+    return (long long)st.st_size;
+}
+
+// Number of relocation entries in an ELF64 object (sum over SHT_REL/SHT_RELA
+// sections). Returns -1 when the file cannot be read or is not ELF64.
+static long long count_relocations(const std::string &obj_path) {
+#ifdef __linux__
+    std::ifstream f(obj_path, std::ios::binary);
+    Elf64_Ehdr eh;
+    if (!f.read(reinterpret_cast<char*>(&eh), sizeof(eh))) return -1;
+    if (std::string(reinterpret_cast<char*>(eh.e_ident), 4) != std::string(ELFMAG, 4) ||
+        eh.e_ident[EI_CLASS] != ELFCLASS64) return -1;
+    long long relocs = 0;
+    for (int i = 0; i < eh.e_shnum; ++i) {
+        Elf64_Shdr sh;
+        f.seekg((std::streamoff)(eh.e_shoff + (Elf64_Off)i * eh.e_shentsize));
+        if (!f.read(reinterpret_cast<char*>(&sh), sizeof(sh))) return -1;
+        if ((sh.sh_type == SHT_RELA || sh.sh_type == SHT_REL) && sh.sh_entsize)
+            relocs += (long long)(sh.sh_size / sh.sh_entsize);
+    }
+    return relocs;
+#else
+    (void)obj_path;
+    return -1;
+#endif
+}
+
 static bool ensure_dirs(const RunConfig &cfg) {
     bool a = myfs::create_directories(cfg.workdir);
     bool b = myfs::create_directories(myfs::parent_path(cfg.out_bin));
@@ -194,6 +227,15 @@ static bool run_pipeline(const RunConfig &cfg, std::string &report_json_out) {
     out << "    \"string_intensity\": " << cfg.string_intensity << ",\n";
     out << "    \"cycles\": " << cfg.cycles << "\n";
     out << "  },\n";
+    out << "  \"binary\": {\n";
+#ifdef _WIN32
+    out << "    \"size_bytes\": " << file_size(cfg.out_bin + ".exe") << ",\n";
+#else
+    out << "    \"size_bytes\": " << file_size(cfg.out_bin) << ",\n";
+#endif
+    out << "    \"object_size_bytes\": " << file_size(obj) << ",\n";
+    out << "    \"object_relocations\": " << count_relocations(obj) << "\n";
+    out << "  },\n";
     out << "  \"counters\": " << (counters_data.empty() ? "{}" : counters_data) << "\n";
     out << "}\n";
     out.close();
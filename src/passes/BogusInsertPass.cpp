@@ -1,104 +1,348 @@
 #include "BogusInsertPass.h" // Include the declaration
+#include "ObfUtils.h"
 
 // Add all necessary includes for the implementation here
 #include "llvm/IR/Function.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+#include <algorithm>
+#include <functional>
 #include <random>
 #include <string>
+#include <vector>
+
+namespace {
+
+// An opaque predicate: an i1 that is always true at run time but that the
+// optimizer cannot fold. Inputs come from volatile loads of the module's
+// __obf_opaque_state global, which holds an odd constant and is never
+// written, so every load returns the same odd value. `Load` emits a fresh
+// load; using two loads where a predicate squares a value keeps LLVM from
+// seeing the square. Latency is the estimated critical path in cycles,
+// counting an L1 load as 4, a multiply as 3 and other ALU ops as 1.
+using LoadFn = std::function<llvm::Value *()>;
+struct OpaquePredicate {
+    const char *Name;
+    unsigned Latency;
+    llvm::Value *(*Build)(llvm::IRBuilder<> &B, const LoadFn &Load);
+};
+
+const OpaquePredicate Predicates[] = {
+    // a ^ a == 0
+    {"xor-self", 6, [](llvm::IRBuilder<> &B, const LoadFn &Load) -> llvm::Value * {
+        return B.CreateICmpEQ(B.CreateXor(Load(), Load()), B.getInt32(0));
+    }},
+    // the state is odd
+    {"odd-state", 6, [](llvm::IRBuilder<> &B, const LoadFn &Load) -> llvm::Value * {
+        return B.CreateICmpNE(B.CreateAnd(Load(), B.getInt32(1)), B.getInt32(0));
+    }},
+    // squares are 0 or 1 mod 4
+    {"square-mod4", 9, [](llvm::IRBuilder<> &B, const LoadFn &Load) -> llvm::Value * {
+        llvm::Value *sq = B.CreateMul(Load(), Load());
+        return B.CreateICmpULT(B.CreateAnd(sq, B.getInt32(3)), B.getInt32(2));
+    }},
+    // odd squares are 1 mod 8
+    {"odd-square-mod8", 9, [](llvm::IRBuilder<> &B, const LoadFn &Load) -> llvm::Value * {
+        llvm::Value *sq = B.CreateMul(Load(), Load());
+        return B.CreateICmpEQ(B.CreateAnd(sq, B.getInt32(7)), B.getInt32(1));
+    }},
+    // x * (x + 1) is even
+    {"consecutive-even", 10, [](llvm::IRBuilder<> &B, const LoadFn &Load) -> llvm::Value * {
+        llvm::Value *x = Load();
+        llvm::Value *p = B.CreateMul(x, B.CreateAdd(Load(), B.getInt32(1)));
+        return B.CreateICmpEQ(B.CreateAnd(p, B.getInt32(1)), B.getInt32(0));
+    }},
+    // x^2 != 7y^2 - 1 (no solution mod 8, hence none mod 2^32)
+    {"seven-square", 12, [](llvm::IRBuilder<> &B, const LoadFn &Load) -> llvm::Value * {
+        llvm::Value *x2 = B.CreateMul(Load(), Load());
+        llvm::Value *y2 = B.CreateMul(Load(), Load());
+        llvm::Value *rhs = B.CreateSub(B.CreateMul(y2, B.getInt32(7)), B.getInt32(1));
+        return B.CreateICmpNE(x2, rhs);
+    }},
+};
+
+} // namespace
 
 // This is the DEFINITION (implementation) of the class methods.
 
-BogusInsertPass::BogusInsertPass() : Seed_(0x87654321), Inserted_(0) {
-    if (const char *env = std::getenv("LLVM_OBF_SEED")) {
+BogusInsertPass::BogusInsertPass() : BogusInsertPass(obfCycle()) {}
+
+BogusInsertPass::BogusInsertPass(unsigned CycleIdx)
+    : Seed_(obfGlobalSeed(0x87654321)), Cycle_(CycleIdx), MaxLatency_(10),
+      Layout_(JunkLayout::Cold), Ratio_(30), Budget_(16), InLoops_(false),
+      HotPercentile_(obfHotPercentile()) {
+    if (const char *of = std::getenv("OFILE")) StatsFile_ = of;
+    if (const char *env = std::getenv("LLVM_OBF_OPAQUE_MAX_LATENCY")) {
         try {
-            Seed_ = static_cast<uint32_t>(std::stoul(std::string(env)));
+            MaxLatency_ = static_cast<unsigned>(std::stoul(std::string(env)));
         } catch (...) {
-            // Ignore malformed environment value and keep default seed.
+            // Ignore malformed environment value and keep the default budget.
         }
     }
+    if (const char *env = std::getenv("LLVM_OBF_BOGUS_RATIO")) {
+        try {
+            Ratio_ = std::min(100u, static_cast<unsigned>(std::stoul(std::string(env))));
+        } catch (...) {}
+    }
+    if (const char *env = std::getenv("LLVM_OBF_BOGUS_BUDGET")) {
+        try {
+            Budget_ = static_cast<unsigned>(std::stoul(std::string(env)));
+        } catch (...) {}
+    }
+    if (const char *env = std::getenv("LLVM_OBF_BOGUS_LOOPS")) {
+        InLoops_ = std::string(env) != "0";
+    }
+    if (const char *env = std::getenv("LLVM_OBF_JUNK_LAYOUT")) {
+        std::string layout(env);
+        if (layout == "inline") Layout_ = JunkLayout::Inline;
+        else if (layout == "cold") Layout_ = JunkLayout::Cold;
+        else if (layout == "outline") Layout_ = JunkLayout::Outline;
+        else llvm::errs() << "[BogusInsert] unknown LLVM_OBF_JUNK_LAYOUT '"
+                          << layout << "', using 'cold'\n";
+    }
 }
 
 llvm::PreservedAnalyses
-BogusInsertPass::run(llvm::Module &M, llvm::ModuleAnalysisManager &) {
+BogusInsertPass::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
     llvm::LLVMContext &Ctx = M.getContext();
-    std::mt19937 rng(Seed_);
+    unsigned inserted = 0;
 
     llvm::Type *i32 = llvm::Type::getInt32Ty(Ctx);
 
-    llvm::FunctionType *opaqueFT = llvm::FunctionType::get(i32, {i32}, false);
-    llvm::FunctionCallee opaqueFunc =
-        M.getOrInsertFunction("__obf_opaque", opaqueFT);
+    // Predicates within the latency budget; if the budget is below every
+    // predicate, fall back to the cheapest one.
+    std::vector<const OpaquePredicate *> usable;
+    const OpaquePredicate *cheapest = &Predicates[0];
+    for (const OpaquePredicate &P : Predicates) {
+        if (P.Latency <= MaxLatency_)
+            usable.push_back(&P);
+        if (P.Latency < cheapest->Latency)
+            cheapest = &P;
+    }
+    if (usable.empty())
+        usable.push_back(cheapest);
+
+    // Shared input of all predicates. Only ever read through volatile loads,
+    // so its (odd) initializer is never propagated into the predicates.
+    llvm::GlobalVariable *state = nullptr;
+    unsigned totalLatency = 0;
+    // Never-taken arms, outlined once the walk over M is done (outlining adds
+    // functions to M).
+    std::vector<llvm::BasicBlock *> junkBlocks;
+    llvm::MDNode *neverTaken =
+        llvm::MDBuilder(Ctx).createBranchWeights(1 << 20, 1);
+
+    llvm::FunctionAnalysisManager &FAM =
+        MAM.getResult<llvm::FunctionAnalysisManagerModuleProxy>(M).getManager();
+    // Per-function counts for the stats file, in module order.
+    std::vector<std::pair<std::string, unsigned>> perFunction;
+    llvm::ProfileSummaryInfo &PSI = MAM.getResult<llvm::ProfileSummaryAnalysis>(M);
+    const bool profiled = obfUseProfile(&PSI, HotPercentile_);
+    uint64_t totalOverhead = 0;
 
     for (llvm::Function &F : M) {
         if (F.isDeclaration() || F.empty() || F.getName().startswith("__obf_")) {
             continue;
         }
 
+        // Candidates are taken before any block is split. Innermost loops
+        // run the most often, so their blocks are left alone by default.
+        // With a profile, hot blocks are skipped as well.
+        llvm::LoopInfo &LI = FAM.getResult<llvm::LoopAnalysis>(F);
+        llvm::BlockFrequencyInfo *BFI =
+            profiled ? &FAM.getResult<llvm::BlockFrequencyAnalysis>(F) : nullptr;
+        struct Candidate {
+            llvm::BasicBlock *BB;
+            ObfHeat Heat;
+            uint64_t Count;
+        };
+        std::vector<Candidate> candidates;
+        unsigned skippedInLoops = 0, skippedHot = 0;
+        for (llvm::BasicBlock &BB : F) {
+            if (BB.isEHPad())
+                continue;
+            llvm::Loop *L = LI.getLoopFor(&BB);
+            if (!InLoops_ && L && L->isInnermost()) {
+                ++skippedInLoops;
+                continue;
+            }
+            Candidate C{&BB, ObfHeat::Cold, 0};
+            if (BFI) {
+                C.Heat = obfBlockHeat(BB, *BFI, PSI, HotPercentile_);
+                C.Count = obfBlockCount(BB, *BFI);
+            }
+            if (C.Heat == ObfHeat::Hot) {
+                ++skippedHot;
+                continue;
+            }
+            candidates.push_back(C);
+        }
+        uint64_t baseline = BFI ? obfDynamicInstructions(F, *BFI) : 0;
+        uint64_t overhead = 0;
+
+        // Choices for F depend only on F's name, never on which functions
+        // were visited before it.
+        std::mt19937 rng(obfDeriveSeed(Seed_, F.getName(), "bogus-insert", Cycle_));
         llvm::BasicBlock *originalEntry = &F.getEntryBlock();
+        llvm::AllocaInst *tmp = nullptr;
+        unsigned insertedHere = 0;
 
-        // --- THE CORRECT FIX: Create the AllocaInst FIRST ---
-        // An AllocaInst must be at the top of the function. We create it
-        // using the recommended safe IRBuilder constructor before any
-        // other modifications are made to the block.
-        llvm::IRBuilder<> TopB(originalEntry, originalEntry->begin());
-        llvm::AllocaInst *tmp = TopB.CreateAlloca(i32, nullptr, "ob_tmp");
-
-        // Now, find the first instruction to split *after*.
-        llvm::Instruction *splitPoint = originalEntry->getFirstNonPHIOrDbgOrLifetime();
-        if (!splitPoint || splitPoint->isTerminator()) {
-            continue; // Not enough instructions to safely split.
-        }
+        for (const Candidate &C : candidates) {
+            if (insertedHere >= Budget_)
+                break;
+            unsigned ratio = C.Heat == ObfHeat::Warm ? Ratio_ / 2 : Ratio_;
+            if (rng() % 100 >= ratio)
+                continue;
+            llvm::BasicBlock *BB = C.BB;
 
-        // We will split the block *after* the splitPoint instruction.
-        // This ensures the original block is never empty.
-        llvm::BasicBlock *mainPart = originalEntry->splitBasicBlock(splitPoint->getNextNode(), "entry.main");
+            // An AllocaInst must be at the top of the function; create the
+            // one scratch slot the arms store to before the first split.
+            if (!tmp) {
+                llvm::IRBuilder<> TopB(originalEntry, originalEntry->begin());
+                tmp = TopB.CreateAlloca(i32, nullptr, "ob_tmp");
+            }
 
-        // The original entry block now has a terminator jumping to 'mainPart'. Remove it.
-        originalEntry->getTerminator()->eraseFromParent();
+            // Split in front of the block's code: PHIs (and the entry's
+            // static allocas) stay in the head, which gets the bogus branch.
+            llvm::BasicBlock::iterator splitPoint = BB->getFirstInsertionPt();
+            if (BB == originalEntry)
+                while (llvm::isa<llvm::AllocaInst>(*splitPoint))
+                    ++splitPoint;
+            llvm::BasicBlock *mainPart = BB->splitBasicBlock(splitPoint, BB->getName() + ".main");
 
-        // Now, build our bogus logic at the end of the original entry block.
-        llvm::IRBuilder<> B(originalEntry);
+            // The head now has a terminator jumping to 'mainPart'. Remove it.
+            BB->getTerminator()->eraseFromParent();
 
-        uint32_t arg = rng() & 0xFFFF;
-        llvm::Value *argV = llvm::ConstantInt::get(i32, arg);
-        llvm::CallInst *call = B.CreateCall(opaqueFunc, {argV});
-        call->setTailCall(false);
+            // Now, build our bogus logic at the end of the head.
+            llvm::IRBuilder<> B(BB);
+            uint32_t arg = rng() & 0xFFFF;
+            if (!state) {
+                uint32_t init = obfDeriveSeed(Seed_, "__obf_opaque_state", "bogus-insert", Cycle_);
+                state = new llvm::GlobalVariable(
+                    M, i32, false, llvm::GlobalValue::InternalLinkage,
+                    llvm::ConstantInt::get(i32, init | 1u), "__obf_opaque_state");
+            }
+            LoadFn load = [&]() -> llvm::Value * {
+                return B.CreateLoad(i32, state, /*isVolatile=*/true, "ob_state");
+            };
+            const OpaquePredicate *P = usable[rng() % usable.size()];
+            llvm::Value *cmp = P->Build(B, load);
+            totalLatency += P->Latency;
+            // The predicate, the branch and the store in ob_true.
+            overhead += C.Count * (P->Latency + 2);
 
-        llvm::Value *masked = B.CreateAnd(call, llvm::ConstantInt::get(i32, 0xFF));
-        llvm::Value *cmp = B.CreateICmpEQ(masked, llvm::ConstantInt::get(i32, 0));
+            // Create the true/false blocks for our bogus conditional.
+            llvm::BasicBlock *bbTrue = llvm::BasicBlock::Create(Ctx, "ob_true", &F, mainPart);
+            llvm::BasicBlock *bbFalse = llvm::BasicBlock::Create(Ctx, "ob_false", &F, mainPart);
 
-        // Create the true/false blocks for our bogus conditional.
-        llvm::BasicBlock *bbTrue = llvm::BasicBlock::Create(Ctx, "ob_true", &F, mainPart);
-        llvm::BasicBlock *bbFalse = llvm::BasicBlock::Create(Ctx, "ob_false", &F, mainPart);
+            // Make the head branch to our new blocks. The predicate always
+            // holds, so ob_false is dead at run time: say so with branch
+            // weights and keep it out of the hot path's layout.
+            llvm::BranchInst *br = B.CreateCondBr(cmp, bbTrue, bbFalse);
+            if (Layout_ != JunkLayout::Inline) {
+                br->setMetadata(llvm::LLVMContext::MD_prof, neverTaken);
+                bbFalse->moveAfter(&F.back());
+            }
+            if (Layout_ == JunkLayout::Outline)
+                junkBlocks.push_back(bbFalse);
 
-        // Make the entry block branch to our new blocks
-        B.CreateCondBr(cmp, bbTrue, bbFalse);
+            // The stores are volatile so the optimizer cannot drop both arms
+            // as dead and fold the predicate away with them.
+            // Fill the true block, then branch to the rest of the block
+            llvm::IRBuilder<> TrueB(bbTrue);
+            llvm::Value *t1 = TrueB.CreateAdd(llvm::ConstantInt::get(i32, arg),
+                                              llvm::ConstantInt::get(i32, 13));
+            llvm::Value *t2 = TrueB.CreateMul(t1, llvm::ConstantInt::get(i32, 7));
+            TrueB.CreateStore(t2, tmp, /*isVolatile=*/true);
+            TrueB.CreateBr(mainPart);
 
-        // Fill the true block, then branch to the rest of the original function
-        llvm::IRBuilder<> TrueB(bbTrue);
-        llvm::Value *t1 = TrueB.CreateAdd(llvm::ConstantInt::get(i32, arg),
-                                          llvm::ConstantInt::get(i32, 13));
-        llvm::Value *t2 = TrueB.CreateMul(t1, llvm::ConstantInt::get(i32, 7));
-        TrueB.CreateStore(t2, tmp);
-        TrueB.CreateBr(mainPart);
+            // Fill the false block, then branch to the rest of the block
+            llvm::IRBuilder<> FalseB(bbFalse);
+            llvm::Value *f1 = FalseB.CreateSub(llvm::ConstantInt::get(i32, arg),
+                                               llvm::ConstantInt::get(i32, 3));
+            llvm::Value *f2 = FalseB.CreateShl(f1, llvm::ConstantInt::get(i32, 2));
+            FalseB.CreateStore(f2, tmp, /*isVolatile=*/true);
+            FalseB.CreateBr(mainPart);
 
-        // Fill the false block, then branch to the rest of the original function
-        llvm::IRBuilder<> FalseB(bbFalse);
-        llvm::Value *f1 = FalseB.CreateSub(llvm::ConstantInt::get(i32, arg),
-                                           llvm::ConstantInt::get(i32, 3));
-        llvm::Value *f2 = FalseB.CreateShl(f1, llvm::ConstantInt::get(i32, 2));
-        FalseB.CreateStore(f2, tmp);
-        FalseB.CreateBr(mainPart);
+            ++insertedHere;
+        }
 
-        ++Inserted_;
+        if (insertedHere > 0) {
+            llvm::errs() << "[BogusInsert] " << F.getName() << ": " << insertedHere
+                         << " of " << candidates.size() << " blocks";
+            if (skippedInLoops)
+                llvm::errs() << " (" << skippedInLoops << " in innermost loops skipped)";
+            if (skippedHot)
+                llvm::errs() << " (" << skippedHot << " hot skipped)";
+            llvm::errs() << "\n";
+            FAM.invalidate(F, llvm::PreservedAnalyses::none());
+        }
+        if (BFI) {
+            obfReportOverhead("bogus-insert", F, overhead, baseline);
+            totalOverhead += overhead;
+        }
+        perFunction.push_back({F.getName().str(), insertedHere});
+        inserted += insertedHere;
     }
 
-    if (Inserted_ > 0) {
-        llvm::errs() << "[BogusInsert] inserted " << Inserted_ << " blocks\n";
+    // Move the dead arms into cold functions of their own; on ELF they go to
+    // .text.unlikely so the linker groups them away from hot code.
+    unsigned outlined = 0;
+    bool elf = llvm::Triple(M.getTargetTriple()).isOSBinFormatELF();
+    for (llvm::BasicBlock *junk : junkBlocks) {
+        llvm::Function &F = *junk->getParent();
+        llvm::CodeExtractorAnalysisCache CEAC(F);
+        llvm::CodeExtractor CE({junk}, nullptr, false, nullptr, nullptr, nullptr,
+                               false, false, "ob_cold");
+        if (!CE.isEligible())
+            continue;
+        llvm::Function *cold = CE.extractCodeRegion(CEAC);
+        if (!cold)
+            continue;
+        cold->addFnAttr(llvm::Attribute::Cold);
+        cold->addFnAttr(llvm::Attribute::NoInline);
+        cold->addFnAttr(llvm::Attribute::MinSize);
+        if (elf)
+            cold->setSection(".text.unlikely");
+        // The stub block calling it replaces the arm; keep it at the end too.
+        for (llvm::User *U : cold->users())
+            if (auto *call = llvm::dyn_cast<llvm::CallInst>(U))
+                call->getParent()->moveAfter(&F.back());
+        ++outlined;
+    }
+
+    if (inserted > 0) {
+        llvm::errs() << "[BogusInsert] inserted " << inserted << " blocks\n";
+    }
+
+    if (!StatsFile_.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream os(StatsFile_, EC);
+        if (!EC) {
+            os << "{\n";
+            os << "  \"num_bogus_blocks\": " << inserted << ",\n";
+            os << "  \"opaque_predicate_cycles\": " << totalLatency << ",\n";
+            os << "  \"num_outlined_junk_blocks\": " << outlined << ",\n";
+            os << "  \"expected_overhead_cycles\": " << totalOverhead << ",\n";
+            os << "  \"bogus_blocks_per_function\": {";
+            for (size_t i = 0; i < perFunction.size(); ++i) {
+                os << (i ? ",\n    \"" : "\n    \"");
+                os.write_escaped(perFunction[i].first);
+                os << "\": " << perFunction[i].second;
+            }
+            os << (perFunction.empty() ? "}\n" : "\n  }\n");
+            os << "}\n";
+        }
     }
-    return llvm::PreservedAnalyses::all();
+    return inserted > 0 ? llvm::PreservedAnalyses::none()
+                         : llvm::PreservedAnalyses::all();
 }
\ No newline at end of file
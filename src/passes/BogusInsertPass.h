@@ -2,16 +2,46 @@
 
 #include "llvm/IR/PassManager.h"
 #include <cstdint>
+#include <string>
 
 // The DECLARATION of the BogusInsertPass class.
 class BogusInsertPass : public llvm::PassInfoMixin<BogusInsertPass> {
+public:
+    // Where the never-taken arm of each bogus branch goes.
+    //  Inline:  right after the entry block, no profile data (legacy).
+    //  Cold:    !prof weights marking it never taken, block moved to the end
+    //           of the function.
+    //  Outline: as Cold, and the arm is extracted into a cold, noinline
+    //           function placed in .text.unlikely on ELF targets.
+    // Selected with LLVM_OBF_JUNK_LAYOUT=inline|cold|outline.
+    enum class JunkLayout { Inline, Cold, Outline };
+
 private:
     uint32_t Seed_;
-    unsigned Inserted_;
+    unsigned Cycle_;
+    // Only opaque predicates whose estimated latency (cycles) fits in this
+    // budget are used. LLVM_OBF_OPAQUE_MAX_LATENCY, default 10.
+    unsigned MaxLatency_;
+    JunkLayout Layout_;
+    // Chance, in percent, that a bogus branch is put in front of each basic
+    // block. LLVM_OBF_BOGUS_RATIO, default 30.
+    unsigned Ratio_;
+    // At most this many bogus branches per function.
+    // LLVM_OBF_BOGUS_BUDGET, default 16.
+    unsigned Budget_;
+    // Blocks of innermost loops are skipped unless LLVM_OBF_BOGUS_LOOPS=1.
+    bool InLoops_;
+    // With profile data, hot blocks are skipped and warm blocks use half the
+    // ratio. LLVM_OBF_HOT_PERCENTILE.
+    unsigned HotPercentile_;
+    // OFILE, read at construction.
+    std::string StatsFile_;
 
 public:
     // Constructor declaration
     BogusInsertPass();
+    // Round given by the pipeline (`bogus-insert<cycle=N>`), not LLVM_OBF_CYCLE.
+    explicit BogusInsertPass(unsigned CycleIdx);
 
     // Run method declaration
     llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &);
@@ -1,11 +1,25 @@
 #include "ControlFlowFlatteningPass.h" // Use the header for the declaration
+#include "ObfUtils.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include <climits>
+#include <map>
+#include <memory>
 #include <random>
+#include <set>
+#include <string>
+#include <tuple>
 #include <vector>
 
 using namespace llvm;
@@ -13,86 +27,518 @@ using namespace llvm;
 // NOTE: The incorrect 'namespace llvm { ... }' wrapper has been removed.
 // The implementation is now in the global namespace, matching the header.
 
-PreservedAnalyses ControlFlowFlatteningPass::run(Function &F, FunctionAnalysisManager &AM) {
-    if (F.isDeclaration() || F.empty() || F.size() <= 2) {
-        return PreservedAnalyses::all();
+namespace {
+
+// One dispatcher: the whole function, or a loop kept as a unit that has a
+// dispatcher of its own. Holds the state variable and the blocks it can
+// dispatch to, numbered in order of first use.
+struct Level {
+    AllocaInst *State = nullptr;
+    BasicBlock *Dispatch = nullptr;  // not used by the threaded dispatcher
+    Value *Loaded = nullptr;         // encoded state loaded in Dispatch
+    GlobalVariable *Table = nullptr; // indirect and threaded dispatchers
+    uint32_t Key = 0, Mul = 1, MulInv = 1; // state encoding
+    std::vector<BasicBlock*> Targets;
+    std::map<BasicBlock*, unsigned> StateOf;
+};
+
+// How one edge is taken after flattening: through Via's dispatcher to
+// Target, or directly when Via is null.
+struct Route {
+    Level *Via = nullptr;
+    BasicBlock *Target = nullptr;
+};
+
+} // namespace
+
+ControlFlowFlatteningPass::ControlFlowFlatteningPass()
+    : ControlFlowFlatteningPass(obfCycle()) {}
+
+ControlFlowFlatteningPass::ControlFlowFlatteningPass(unsigned CycleIdx)
+    : DispatchKind(Dispatch::Switch), StateEncoding(Encoding::None),
+      Seed(obfGlobalSeed(0xc0ffee11)), Cycle(CycleIdx),
+      MaxLoopDepth(UINT_MAX), LoopSize(0), LoopDispatch(false),
+      HotPercentile(obfHotPercentile()) {
+    if (const char *env = std::getenv("LLVM_OBF_CFF_DISPATCH")) {
+        std::string kind(env);
+        if (kind == "switch") DispatchKind = Dispatch::Switch;
+        else if (kind == "indirect") DispatchKind = Dispatch::Indirect;
+        else if (kind == "threaded") DispatchKind = Dispatch::Threaded;
+        else errs() << "[CFF] unknown LLVM_OBF_CFF_DISPATCH '" << kind
+                    << "', using 'switch'\n";
+    }
+    if (const char *env = std::getenv("LLVM_OBF_CFF_STATE_ENCODING")) {
+        std::string kind(env);
+        if (kind == "none") StateEncoding = Encoding::None;
+        else if (kind == "xor") StateEncoding = Encoding::Xor;
+        else if (kind == "affine") StateEncoding = Encoding::Affine;
+        else errs() << "[CFF] unknown LLVM_OBF_CFF_STATE_ENCODING '" << kind
+                    << "', using 'none'\n";
+    }
+    if (const char *env = std::getenv("LLVM_OBF_CFF_MAX_LOOP_DEPTH")) {
+        try { MaxLoopDepth = static_cast<unsigned>(std::stoul(env)); } catch (...) {}
+    }
+    if (const char *env = std::getenv("LLVM_OBF_CFF_LOOP_SIZE")) {
+        try { LoopSize = static_cast<unsigned>(std::stoul(env)); } catch (...) {}
+    }
+    if (const char *env = std::getenv("LLVM_OBF_CFF_LOOP_DISPATCH")) {
+        LoopDispatch = std::string(env) != "0";
     }
+    if (const char *of = std::getenv("OFILE"))
+        StatsFile = of;
+}
 
-    std::vector<BasicBlock*> origBBs;
-    for (BasicBlock &BB : F) {
-        origBBs.push_back(&BB);
+PreservedAnalyses ControlFlowFlatteningPass::run(Module &M, ModuleAnalysisManager &MAM) {
+    FunctionAnalysisManager &FAM =
+        MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    const ProfileSummaryInfo *PSI = &MAM.getResult<ProfileSummaryAnalysis>(M);
+    Counts counts;
+    bool changed = false;
+    for (Function &F : M) {
+        if (F.isDeclaration() || F.empty() || F.size() <= 2)
+            continue;
+        if (runOnFunction(F, FAM, PSI, counts)) {
+            changed = true;
+            FAM.invalidate(F, PreservedAnalyses::none());
+        }
     }
-    
-    BasicBlock *entryBlock = &F.getEntryBlock();
-    origBBs.erase(std::remove(origBBs.begin(), origBBs.end(), entryBlock), origBBs.end());
-    
-    // Detach all original blocks from the function, except the entry block.
-    for (BasicBlock *BB : origBBs) {
-        BB->removeFromParent();
+
+    if (counts.Rewired && !StatsFile.empty()) {
+        std::error_code EC;
+        raw_fd_ostream os(StatsFile, EC);
+        if (!EC) {
+            os << "{\n";
+            os << "  \"num_flattened_branches\": " << counts.Rewired << ",\n";
+            os << "  \"num_demoted_slots\": " << counts.Demoted << ",\n";
+            os << "  \"expected_overhead_cycles\": " << counts.Overhead << "\n";
+            os << "}\n";
+        }
     }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+bool ControlFlowFlatteningPass::runOnFunction(Function &F, FunctionAnalysisManager &AM,
+                                              const ProfileSummaryInfo *PSI,
+                                              Counts &C) const {
 
     LLVMContext &Ctx = F.getContext();
-    BasicBlock *dispatchBlock = BasicBlock::Create(Ctx, "dispatch", &F);
-    BasicBlock *returnBlock = BasicBlock::Create(Ctx, "returnBlock", &F);
-
-    // Setup the entry block to initialize the state and jump to the dispatcher
-    entryBlock->getTerminator()->eraseFromParent();
-    IRBuilder<> builder(entryBlock);
-    AllocaInst *stateVar = builder.CreateAlloca(builder.getInt32Ty(), nullptr, "cff_state");
-    builder.CreateStore(builder.getInt32(1), stateVar); // Start with state 1
-    builder.CreateBr(dispatchBlock);
-
-    // Create the dispatcher's switch statement
-    builder.SetInsertPoint(dispatchBlock);
-    LoadInst *loadState = builder.CreateLoad(builder.getInt32Ty(), stateVar, "load_cff_state");
-    SwitchInst *switcher = builder.CreateSwitch(loadState, returnBlock, origBBs.size());
-
-    // Re-wire all original blocks to work with the dispatcher
-    for (size_t i = 0; i < origBBs.size(); ++i) {
-        BasicBlock *BB = origBBs[i];
-        F.getBasicBlockList().push_back(BB); 
-        switcher->addCase(builder.getInt32(i + 1), BB);
-
-        Instruction *terminator = BB->getTerminator();
-        if (isa<ReturnInst>(terminator)) {
-            builder.SetInsertPoint(terminator);
-            builder.CreateStore(builder.getInt32(0), stateVar); // State 0 can mean "exit"
-            builder.CreateBr(returnBlock); // Jump to the common return block
-            terminator->eraseFromParent();
-        } else if (BranchInst *br = dyn_cast<BranchInst>(terminator)) {
+    BasicBlock *entryBlock = &F.getEntryBlock();
+    const bool useTable = DispatchKind != Dispatch::Switch;
+    // Switch states start at 1 as they always have; table states index the
+    // blockaddress table directly.
+    const unsigned base = useTable ? 0 : 1;
+
+    // An invoke result feeding a PHI in its normal destination exists only
+    // on that edge, so a demoted PHI could not be stored for it in the
+    // invoking block. Give such edges a block of their own first.
+    bool splitInvokes = false;
+    for (BasicBlock &BB : F) {
+        auto *invoke = dyn_cast<InvokeInst>(BB.getTerminator());
+        if (!invoke)
+            continue;
+        BasicBlock *normal = invoke->getNormalDest();
+        for (PHINode &phi : normal->phis()) {
+            if (phi.getIncomingValueForBlock(&BB) == invoke) {
+                SplitEdge(&BB, normal);
+                splitInvokes = true;
+                break;
+            }
+        }
+    }
+    if (splitInvokes)
+        AM.invalidate(F, PreservedAnalyses::none());
+
+    // --- Profile: leave hot code alone ---
+    BlockFrequencyInfo *BFI = nullptr;
+    std::map<BasicBlock*, uint64_t> countOf;
+    uint64_t baseline = 0;
+    if (obfUseProfile(PSI, HotPercentile)) {
+        BFI = &AM.getResult<BlockFrequencyAnalysis>(F);
+        if (obfBlockHeat(*entryBlock, *BFI, *PSI, HotPercentile) == ObfHeat::Hot) {
+            errs() << "[CFF] " << F.getName() << ": hot entry, not flattened\n";
+            return splitInvokes;
+        }
+        for (BasicBlock &BB : F)
+            countOf[&BB] = obfBlockCount(BB, *BFI);
+        baseline = obfDynamicInstructions(F, *BFI);
+    }
+    auto isHot = [&](BasicBlock *BB) {
+        return BFI && obfBlockHeat(*BB, *BFI, *PSI, HotPercentile) == ObfHeat::Hot;
+    };
+
+    // --- Regions: loops kept as compact single-entry units ---
+    // A loop is kept when it is nested deeper than MaxLoopDepth, when it is
+    // innermost and has at most LoopSize blocks, or when its header is hot;
+    // its sub-loops go with it. Everything else is flattened into the
+    // function-level dispatcher.
+    LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
+    std::vector<Loop*> kept;
+    std::vector<Loop*> worklist(LI.begin(), LI.end());
+    while (!worklist.empty()) {
+        Loop *L = worklist.back();
+        worklist.pop_back();
+        if (L->getLoopDepth() > MaxLoopDepth ||
+            (L->isInnermost() && L->getNumBlocks() <= LoopSize) ||
+            isHot(L->getHeader())) {
+            kept.push_back(L);
+            continue;
+        }
+        worklist.insert(worklist.end(), L->begin(), L->end());
+    }
+
+    Level top;
+    std::vector<std::unique_ptr<Level>> loopLevels;
+    std::map<BasicBlock*, Level*> ownerLevel; // kept loops with a dispatcher
+    std::map<BasicBlock*, Loop*> ownerLoop;   // every block of a kept loop
+    std::map<Loop*, BasicBlock*> entryOf;     // where the outside enters it
+    unsigned keptBlocks = 0;
+    for (Loop *L : kept) {
+        Level *level = nullptr;
+        BasicBlock *entry = L->getHeader();
+        if (LoopDispatch) {
+            loopLevels.push_back(std::make_unique<Level>());
+            level = loopLevels.back().get();
+            // The loop is entered through a block that resets its state to
+            // the header; it belongs to the loop and is rewired with it.
+            entry = BasicBlock::Create(Ctx, "cff.loop.enter", &F, L->getHeader());
+            BranchInst::Create(L->getHeader(), entry);
+            L->addBasicBlockToLoop(entry, LI);
+        }
+        entryOf[L] = entry;
+        for (BasicBlock *BB : L->blocks()) {
+            ownerLoop[BB] = L;
+            if (level)
+                ownerLevel[BB] = level;
+        }
+        keptBlocks += L->getNumBlocks();
+    }
+
+    // --- Routes for every terminator ---
+    // Within a kept loop, edges use the loop's dispatcher or stay direct.
+    // Every other edge goes through the function-level dispatcher, and an
+    // edge into a kept loop lands on the loop's entry. Unwind edges and
+    // edges into EH pads always stay direct.
+    auto stateFor = [&](Level &level, BasicBlock *BB) -> unsigned {
+        auto it = level.StateOf.find(BB);
+        if (it != level.StateOf.end())
+            return it->second;
+        unsigned s = base + level.Targets.size();
+        level.StateOf[BB] = s;
+        level.Targets.push_back(BB);
+        return s;
+    };
+    const bool threaded = DispatchKind == Dispatch::Threaded;
+    // Blocks whose PHIs cannot survive the rewiring because their incoming
+    // edges no longer come straight from the original predecessors.
+    std::set<BasicBlock*> phiBlocks;
+    std::vector<std::pair<Instruction*, std::vector<Route>>> branches;
+    // Estimated cycles per dispatched transition, for the profile report.
+    unsigned transitionCost = DispatchKind == Dispatch::Switch ? 6
+                            : DispatchKind == Dispatch::Indirect ? 5 : 4;
+    if (StateEncoding != Encoding::None)
+        transitionCost += StateEncoding == Encoding::Xor ? 2 : 4;
+    BranchProbabilityInfo *BPI = BFI ? &AM.getResult<BranchProbabilityAnalysis>(F) : nullptr;
+    uint64_t overhead = 0;
+    for (BasicBlock &BB : F) {
+        Instruction *term = BB.getTerminator();
+        if (!isa<BranchInst>(term) && !isa<SwitchInst>(term) && !isa<InvokeInst>(term))
+            continue;
+        Loop *from = ownerLoop.count(&BB) ? ownerLoop[&BB] : nullptr;
+        std::vector<Route> routes;
+        bool anyDispatched = false;
+        // Index order, not successors(): routes[i] must match getSuccessor(i).
+        for (unsigned i = 0; i < term->getNumSuccessors(); ++i) {
+            BasicBlock *succ = term->getSuccessor(i);
+            Loop *to = ownerLoop.count(succ) ? ownerLoop[succ] : nullptr;
+            Route r;
+            r.Target = succ;
+            if (succ->isEHPad() || (isa<InvokeInst>(term) && i == 1)) {
+                routes.push_back(r);
+                continue;
+            }
+            if (from && from == to) {
+                r.Via = ownerLevel.count(succ) ? ownerLevel[succ] : nullptr;
+            } else {
+                r.Via = &top;
+                r.Target = to ? entryOf[to] : succ;
+            }
+            if (r.Via) {
+                stateFor(*r.Via, r.Target);
+                anyDispatched = true;
+                if (BPI && countOf.count(&BB))
+                    overhead += BPI->getEdgeProbability(&BB, i).scale(countOf[&BB]) *
+                                transitionCost;
+                // A shared dispatcher becomes the predecessor of every target.
+                // The threaded one keeps the edge itself, unless it goes
+                // through a per-case stub (switch, invoke) or a loop entry.
+                if (!threaded || !isa<BranchInst>(term))
+                    phiBlocks.insert(r.Target);
+                if (r.Target != succ)
+                    phiBlocks.insert(succ);
+            }
+            routes.push_back(r);
+        }
+        if (anyDispatched)
+            branches.push_back({term, routes});
+    }
+    if (branches.empty()) {
+        return splitInvokes;
+    }
+
+    // Blocks entered only through their level's dispatcher, so the state
+    // variable holds their own state on entry. Edges CFF does not route
+    // (indirectbr, callbr) arrive with whatever was stored last.
+    std::set<std::tuple<Level*, BasicBlock*, BasicBlock*>> routedEdges;
+    for (auto &entry : branches) {
+        Instruction *term = entry.first;
+        for (unsigned i = 0; i < entry.second.size(); ++i) {
+            const Route &r = entry.second[i];
+            if (r.Via && r.Target == term->getSuccessor(i))
+                routedEdges.insert({r.Via, term->getParent(), r.Target});
+        }
+    }
+    auto onlyDispatched = [&](Level &level, BasicBlock *BB) {
+        if (BB == entryBlock || !level.StateOf.count(BB))
+            return false;
+        for (BasicBlock *pred : predecessors(BB))
+            if (!routedEdges.count({&level, pred, BB}))
+                return false;
+        return true;
+    };
+    std::set<BasicBlock*> relativeBlocks;
+    for (auto &entry : branches) {
+        BasicBlock *BB = entry.first->getParent();
+        Level *via = entry.second.front().Via;
+        if (StateEncoding != Encoding::None && via && onlyDispatched(*via, BB))
+            relativeBlocks.insert(BB);
+    }
+
+    // --- Selective demotion, part 1: PHIs ---
+    // Only PHIs at blocks whose predecessors change go to the stack; the
+    // slot is stored at the end of each incoming block, before rewiring.
+    // Walked in function order: the set is ordered by address, which would
+    // make the slot order differ from run to run.
+    unsigned demotedPhis = 0;
+    for (BasicBlock &Block : F) {
+        if (!phiBlocks.count(&Block))
+            continue;
+        BasicBlock *BB = &Block;
+        while (auto *phi = dyn_cast<PHINode>(&BB->front())) {
+            DemotePHIToStack(phi, entryBlock->getFirstNonPHI());
+            ++demotedPhis;
+        }
+    }
+
+    // --- Dispatcher state, tables and dispatch blocks ---
+    IRBuilder<> builder(entryBlock, entryBlock->begin());
+    Type *i32 = builder.getInt32Ty();
+    std::vector<Level*> levels{&top};
+    for (auto &level : loopLevels)
+        levels.push_back(level.get());
+    unsigned tableId = 0;
+    std::mt19937 rng(obfDeriveSeed(Seed, F.getName(), "cff", Cycle));
+    for (Level *level : levels) {
+        if (level->Targets.empty())
+            continue;
+        builder.SetInsertPoint(entryBlock, entryBlock->begin());
+        level->State = builder.CreateAlloca(i32, nullptr, "cff_state");
+        if (StateEncoding != Encoding::None) {
+            level->Key = rng();
+            if (StateEncoding == Encoding::Affine) {
+                level->Mul = rng() | 1;
+                // Newton's iteration for the inverse mod 2^32 of an odd number.
+                level->MulInv = level->Mul;
+                for (int i = 0; i < 5; ++i)
+                    level->MulInv *= 2 - level->Mul * level->MulInv;
+            }
+        }
+        if (useTable) {
+            std::vector<Constant*> addrs;
+            for (BasicBlock *BB : level->Targets)
+                addrs.push_back(BlockAddress::get(&F, BB));
+            ArrayType *tableTy = ArrayType::get(builder.getInt8PtrTy(), addrs.size());
+            std::string name = F.getName().str() + ".cff_table";
+            if (tableId++)
+                name += "." + std::to_string(tableId - 1);
+            level->Table = new GlobalVariable(*F.getParent(), tableTy, true,
+                                              GlobalValue::PrivateLinkage,
+                                              ConstantArray::get(tableTy, addrs), name);
+        }
+    }
+    // Encoded value of `state` in memory (the state itself without an
+    // encoding), the decoded state of a loaded value, and the constant that
+    // takes an encoded `from` to `to`.
+    auto encode = [&](Level &level, unsigned state) -> uint32_t {
+        if (StateEncoding == Encoding::Xor)
+            return state ^ level.Key;
+        return level.Mul * state + level.Key;
+    };
+    auto decode = [&](IRBuilder<> &B, Level &level, Value *enc) -> Value* {
+        if (StateEncoding == Encoding::Xor)
+            return B.CreateXor(enc, level.Key, "cff_dec");
+        if (StateEncoding == Encoding::Affine)
+            return B.CreateMul(B.CreateSub(enc, B.getInt32(level.Key)),
+                               B.getInt32(level.MulInv), "cff_dec");
+        return enc;
+    };
+    auto delta = [&](Level &level, unsigned from, unsigned to) -> uint32_t {
+        if (StateEncoding == Encoding::Xor)
+            return from ^ to;
+        return level.Mul * (to - from);
+    };
+    auto lookup = [&](IRBuilder<> &B, Level &level, Value *state) -> Value* {
+        Type *tableTy = level.Table->getValueType();
+        Value *idx[] = {B.getInt64(0), B.CreateZExt(state, B.getInt64Ty())};
+        Value *slot = B.CreateInBoundsGEP(tableTy, level.Table, idx, "cff_slot");
+        return B.CreateLoad(B.getInt8PtrTy(), slot, "cff_target");
+    };
+    for (Level *level : levels) {
+        if (level->Targets.empty() || DispatchKind == Dispatch::Threaded)
+            continue;
+        BasicBlock *after = level == &top ? entryBlock->getNextNode()
+                                          : level->Targets.front();
+        level->Dispatch = BasicBlock::Create(Ctx, "dispatch", &F, after);
+        builder.SetInsertPoint(level->Dispatch);
+        level->Loaded = builder.CreateLoad(i32, level->State, "load_cff_state");
+        Value *loadState = decode(builder, *level, level->Loaded);
+        if (DispatchKind == Dispatch::Switch) {
+            // Only the states above are ever stored, so the default is dead.
+            BasicBlock *defaultBlock = BasicBlock::Create(Ctx, "cff.default", &F);
+            new UnreachableInst(Ctx, defaultBlock);
+            SwitchInst *switcher = builder.CreateSwitch(loadState, defaultBlock,
+                                                        level->Targets.size());
+            for (BasicBlock *BB : level->Targets)
+                switcher->addCase(builder.getInt32(level->StateOf[BB]), BB);
+        } else {
+            IndirectBrInst *ibr = builder.CreateIndirectBr(lookup(builder, *level, loadState),
+                                                           level->Targets.size());
+            for (BasicBlock *BB : level->Targets)
+                ibr->addDestination(BB);
+        }
+    }
+
+    // Stores the encoded `state` and transfers control through `level`'s
+    // dispatcher. The threaded dispatcher's local indirectbr lists only `dests`.
+    auto jump = [&](IRBuilder<> &B, Level &level, Value *state,
+                    ArrayRef<BasicBlock*> dests) {
+        B.CreateStore(state, level.State);
+        if (DispatchKind == Dispatch::Threaded) {
+            IndirectBrInst *ibr = B.CreateIndirectBr(lookup(B, level, decode(B, level, state)),
+                                                     dests.size());
+            for (BasicBlock *dest : dests)
+                ibr->addDestination(dest);
+        } else {
+            B.CreateBr(level.Dispatch);
+        }
+    };
+
+    // --- Rewire ---
+    unsigned flattened = 0;
+    for (auto &entry : branches) {
+        Instruction *term = entry.first;
+        std::vector<Route> &routes = entry.second;
+        BasicBlock *BB = term->getParent();
+        ++flattened;
+
+        bool sameLevel = isa<BranchInst>(term);
+        for (const Route &r : routes)
+            sameLevel = sameLevel && r.Via == routes.front().Via;
+        if (sameLevel) {
+            // One dispatcher for all successors: select the next state.
+            auto *br = cast<BranchInst>(term);
+            Level &level = *routes.front().Via;
             builder.SetInsertPoint(br);
-            
-            auto find_idx = [&](BasicBlock* target) {
-                for(size_t j = 0; j < origBBs.size(); ++j) {
-                    if(origBBs[j] == target) return (uint32_t)j + 1;
-                }
-                // It might branch back to the entry, which is not in our list. Handle that case.
-                if(target == entryBlock) return (uint32_t)1;
-                return (uint32_t)0; // Default/exit state
+            // A block reached only through this dispatcher finds its own
+            // state in the variable, so the next one can be derived from it.
+            auto from = level.StateOf.find(BB);
+            bool relative = relativeBlocks.count(BB);
+            auto operand = [&](BasicBlock *target) -> Value* {
+                unsigned to = level.StateOf[target];
+                if (relative)
+                    return builder.getInt32(delta(level, from->second, to));
+                return builder.getInt32(encode(level, to));
             };
-
+            Value *nextState;
             if (br->isConditional()) {
-                Value* trueState = builder.getInt32(find_idx(br->getSuccessor(0)));
-                Value* falseState = builder.getInt32(find_idx(br->getSuccessor(1)));
-                Value* nextState = builder.CreateSelect(br->getCondition(), trueState, falseState);
-                builder.CreateStore(nextState, stateVar);
+                nextState = builder.CreateSelect(br->getCondition(), operand(routes[0].Target),
+                                                 operand(routes[1].Target));
             } else {
-                builder.CreateStore(builder.getInt32(find_idx(br->getSuccessor(0))), stateVar);
+                nextState = operand(routes[0].Target);
             }
-            builder.CreateBr(dispatchBlock); // Always go back to the dispatcher
-            terminator->eraseFromParent();
+            if (relative) {
+                // The dispatcher's load dominates every block it alone enters.
+                Value *cur = level.Loaded ? level.Loaded
+                                          : builder.CreateLoad(i32, level.State, "cff_cur");
+                nextState = StateEncoding == Encoding::Xor
+                                ? builder.CreateXor(cur, nextState, "cff_next")
+                                : builder.CreateAdd(cur, nextState, "cff_next");
+            }
+            std::vector<BasicBlock*> dests;
+            for (const Route &r : routes)
+                dests.push_back(r.Target);
+            jump(builder, level, nextState, dests);
+            br->eraseFromParent();
+            continue;
+        }
+
+        // Mixed levels, switch or invoke: keep the terminator, and send each
+        // dispatched edge through a stub that stores its state. This is also
+        // how kept loops are left. Switch cases sharing a successor share
+        // its stub.
+        std::map<BasicBlock*, BasicBlock*> stubOf;
+        for (unsigned i = 0; i < routes.size(); ++i) {
+            if (!routes[i].Via)
+                continue;
+            BasicBlock *succ = term->getSuccessor(i);
+            BasicBlock *&stub = stubOf[succ];
+            if (!stub) {
+                stub = BasicBlock::Create(Ctx, "cff.leave", &F, succ);
+                IRBuilder<> stubB(stub);
+                Level &level = *routes[i].Via;
+                unsigned to = level.StateOf[routes[i].Target];
+                jump(stubB, level,
+                     stubB.getInt32(encode(level, to)),
+                     {routes[i].Target});
+                succ->replacePhiUsesWith(BB, stub);
+            }
+            term->setSuccessor(i, stub);
         }
     }
-    
-    // If the switch gets an unknown state, go to the return block
-    switcher->setDefaultDest(returnBlock);
-    builder.SetInsertPoint(returnBlock);
-    if (F.getReturnType()->isVoidTy()) {
-        builder.CreateRetVoid();
-    } else {
-        // Return a default/undefined value if the function should return something
-        builder.CreateRet(UndefValue::get(F.getReturnType()));
+
+    // --- Selective demotion, part 2: values live across dispatched edges ---
+    // A value keeps its register unless its definition no longer dominates
+    // a use in the flattened CFG. Those few go to entry-block allocas that
+    // mem2reg/SROA can promote again later.
+    DominatorTree DT(F);
+    std::vector<Instruction*> crossing;
+    for (BasicBlock &BB : F) {
+        for (Instruction &I : BB) {
+            if (I.getType()->isVoidTy() || I.getType()->isTokenTy() ||
+                (isa<AllocaInst>(I) && &BB == entryBlock))
+                continue;
+            for (const Use &U : I.uses()) {
+                if (!DT.dominates(&I, U)) {
+                    crossing.push_back(&I);
+                    break;
+                }
+            }
+        }
     }
+    for (Instruction *I : crossing)
+        DemoteRegToStack(*I, false, entryBlock->getFirstNonPHI());
+    const unsigned demoted = demotedPhis + crossing.size();
+
+    errs() << "[CFF] " << F.getName() << ": rewired " << flattened << " branches";
+    if (demoted)
+        errs() << ", demoted " << demoted << " slots (" << demotedPhis << " phis)";
+    if (!kept.empty())
+        errs() << ", kept " << kept.size() << " loops (" << keptBlocks << " blocks)";
+    errs() << "\n";
+    if (BFI)
+        obfReportOverhead("cff", F, overhead, baseline);
 
-    return PreservedAnalyses::none();
-}
\ No newline at end of file
+    C.Rewired += flattened;
+    C.Demoted += demoted;
+    C.Overhead += overhead;
+    return true;
+}
@@ -1,9 +1,72 @@
 #pragma once
 
 #include "llvm/IR/PassManager.h"
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+class ProfileSummaryInfo;
+}
 
 // NOTE: The class is now in the global namespace
 class ControlFlowFlatteningPass : public llvm::PassInfoMixin<ControlFlowFlatteningPass> {
 public:
-    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &AM);
-};
\ No newline at end of file
+    // How control reaches the next flattened block.
+    //  Switch:   every block stores the next state and jumps back to one
+    //            `dispatch` block that switches on it (legacy).
+    //  Indirect: `dispatch` loads the target from a per-function table of
+    //            blockaddresses, indexed by state, and does an indirectbr.
+    //  Threaded: the table lookup and indirectbr are replicated at the end of
+    //            every block, so each block has its own indirect branch site
+    //            instead of all transitions sharing one.
+    // Selected with LLVM_OBF_CFF_DISPATCH=switch|indirect|threaded.
+    enum class Dispatch { Switch, Indirect, Threaded };
+
+    // How the state variable is encoded in memory. The dispatcher still
+    // switches on (or indexes with) the dense decoded state, so jump tables
+    // survive; only the stored values change.
+    //  None:   the plain state.
+    //  Xor:    state ^ K; a transition is cur ^ (s ^ t), decoding is one xor.
+    //  Affine: A*state + K mod 2^32 with A odd; a transition is
+    //          cur + A*(t - s), decoding is (enc - K) * A^-1.
+    // Transitions out of a block entered only through the dispatcher are
+    // computed from the current state; others store the encoded constant.
+    // Per-function keys. Selected with LLVM_OBF_CFF_STATE_ENCODING=none|xor|affine.
+    enum class Encoding { None, Xor, Affine };
+
+private:
+    Dispatch DispatchKind;
+    Encoding StateEncoding;
+    uint32_t Seed;
+    unsigned Cycle;
+    // Loops nested deeper than this are not flattened into the function's
+    // dispatcher but kept as single-entry units (their edges stay direct).
+    // LLVM_OBF_CFF_MAX_LOOP_DEPTH, default unlimited (flatten everything).
+    unsigned MaxLoopDepth;
+    // Innermost loops with at most this many blocks are kept the same way.
+    // LLVM_OBF_CFF_LOOP_SIZE, default 0 (off).
+    unsigned LoopSize;
+    // Give each kept loop a small dispatcher of its own instead of direct
+    // edges. LLVM_OBF_CFF_LOOP_DISPATCH=1.
+    bool LoopDispatch;
+    // With profile data, functions whose entry is hot are left alone and
+    // loops with a hot header are kept as units. LLVM_OBF_HOT_PERCENTILE.
+    unsigned HotPercentile;
+    // OFILE, read at construction.
+    std::string StatsFile;
+
+    // Counts for OFILE, summed over the module by run().
+    struct Counts {
+        unsigned Rewired = 0, Demoted = 0;
+        uint64_t Overhead = 0;
+    };
+    // Flattens F and adds to C; returns whether F changed.
+    bool runOnFunction(llvm::Function &F, llvm::FunctionAnalysisManager &AM,
+                       const llvm::ProfileSummaryInfo *PSI, Counts &C) const;
+
+public:
+    ControlFlowFlatteningPass();
+    // Round given by the pipeline (`cff<cycle=N>`), not LLVM_OBF_CYCLE.
+    explicit ControlFlowFlatteningPass(unsigned CycleIdx);
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+};
@@ -1,71 +1,188 @@
 #include "FakeLoopPass.h" // Use the new header
+#include "ObfUtils.h"
 
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <random>
 
 using namespace llvm;
 
-// Constructor implementation
-FakeLoopPass::FakeLoopPass() : Seed_(0xfeedbeef), Inserted_(0) {
-    if (const char *env = std::getenv("LLVM_OBF_SEED")) {
-        try { Seed_ = static_cast<uint32_t>(std::stoul(std::string(env))); } catch(...) {}
+namespace {
+
+unsigned envUnsigned(const char *Name, unsigned Default) {
+    if (const char *env = std::getenv(Name)) {
+        try {
+            return static_cast<unsigned>(std::stoul(std::string(env)));
+        } catch (...) {
+        }
     }
+    return Default;
+}
+
+// Estimated cycles of one fake loop: the counter's decrement and the
+// compare-and-branch per iteration, plus entering and leaving.
+unsigned loopCost(unsigned Trips) { return 2 * Trips + 2; }
+
+} // namespace
+
+// Constructor implementation
+FakeLoopPass::FakeLoopPass() : FakeLoopPass(obfCycle()) {}
+
+FakeLoopPass::FakeLoopPass(unsigned CycleIdx)
+    : Seed_(obfGlobalSeed(0xfeedbeef)), Cycle_(CycleIdx),
+      MaxLoops_(envUnsigned("LLVM_OBF_FAKE_LOOPS", 1)),
+      Budget_(envUnsigned("LLVM_OBF_FAKE_LOOP_BUDGET", 32)),
+      MinInsts_(envUnsigned("LLVM_OBF_FAKE_LOOP_MIN_INSTS", 16)),
+      HotPercentile_(obfHotPercentile()) {
+    if (const char *of = std::getenv("OFILE"))
+        StatsFile_ = of;
 }
 
 // Run method implementation
-PreservedAnalyses FakeLoopPass::run(Function &F, FunctionAnalysisManager &AM) {
-    if (F.isDeclaration() || F.empty() || F.getName().startswith("__obf_")) {
+PreservedAnalyses FakeLoopPass::run(Module &M, ModuleAnalysisManager &MAM) {
+    FunctionAnalysisManager &FAM =
+        MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    const ProfileSummaryInfo *PSI = &MAM.getResult<ProfileSummaryAnalysis>(M);
+    unsigned inserted = 0;
+    uint64_t overhead = 0;
+    for (Function &F : M) {
+        if (F.isDeclaration() || F.empty() || F.getName().startswith("__obf_"))
+            continue;
+        if (unsigned n = runOnFunction(F, FAM, PSI, overhead)) {
+            inserted += n;
+            FAM.invalidate(F, PreservedAnalyses::none());
+        }
+    }
+
+    if (inserted == 0)
         return PreservedAnalyses::all();
+
+    if (!StatsFile_.empty()) {
+        std::error_code EC;
+        raw_fd_ostream os(StatsFile_, EC);
+        if (!EC) {
+            os << "{\n";
+            os << "  \"num_fake_loops\": " << inserted << ",\n";
+            os << "  \"expected_overhead_cycles\": " << overhead << "\n";
+            os << "}\n";
+        }
+    }
+    return PreservedAnalyses::none();
+}
+
+unsigned FakeLoopPass::runOnFunction(Function &F, FunctionAnalysisManager &AM,
+                                     const ProfileSummaryInfo *PSI,
+                                     uint64_t &Overhead) const {
+    if (F.getInstructionCount() < MinInsts_ || MaxLoops_ == 0) {
+        return 0;
     }
 
     LLVMContext &Ctx = F.getContext();
-    std::mt19937 rng(Seed_);
+    std::mt19937 rng(obfDeriveSeed(Seed_, F.getName(), "fake-loop", Cycle_));
     
     BasicBlock *entryBlock = &F.getEntryBlock();
-    
-    // Find the first valid instruction to split from.
-    BasicBlock::iterator firstRealInst = entryBlock->getFirstInsertionPt();
+    BlockFrequencyInfo &BFI = AM.getResult<BlockFrequencyAnalysis>(F);
+    LoopInfo &LI = AM.getResult<LoopAnalysis>(F);
 
-    if (firstRealInst == entryBlock->end() || entryBlock->isEHPad()) {
-        return PreservedAnalyses::all();
+    // The loops run on every call, so hot functions are skipped.
+    uint64_t baseline = 0;
+    bool profiled = obfUseProfile(PSI, HotPercentile_);
+    if (profiled) {
+        if (obfBlockHeat(*entryBlock, BFI, *PSI, HotPercentile_) == ObfHeat::Hot) {
+            errs() << "[FakeLoop] " << F.getName() << ": hot entry, skipped\n";
+            return 0;
+        }
+        baseline = obfDynamicInstructions(F, BFI);
     }
-    
-    // 1. Create the new blocks for the loop structure.
-    BasicBlock *afterLoop = BasicBlock::Create(Ctx, "fake.loop.after", &F, entryBlock->getNextNode());
-    BasicBlock *loopBody = BasicBlock::Create(Ctx, "fake.loop.body", &F, afterLoop);
-    BasicBlock *loopHeader = BasicBlock::Create(Ctx, "fake.loop.header", &F, loopBody);
-
-    // 2. Move all instructions from the first real one to the end of the entry block
-    //    into our 'afterLoop' block. This clears the way for the loop.
-    afterLoop->getInstList().splice(afterLoop->begin(), entryBlock->getInstList(), firstRealInst, entryBlock->end());
-    
-    // 3. Make the original entry block jump to the loop header.
-    entryBlock->getTerminator()->eraseFromParent();
-    IRBuilder<>(entryBlock).CreateBr(loopHeader);
 
-    // 4. Populate the loop header (the part that runs once).
-    IRBuilder<> headerBuilder(loopHeader);
+    // --- Static cost check ---
+    // A block qualifies when it is outside every real loop (a fake loop
+    // there would run on each iteration) and is not an EH pad. Its weight is
+    // its estimated executions per call.
+    struct Candidate {
+        BasicBlock *BB;
+        double PerCall;
+        uint64_t Count;
+    };
+    std::vector<Candidate> candidates;
+    double entryFreq = static_cast<double>(BFI.getEntryFreq());
+    for (BasicBlock &BB : F) {
+        if (BB.isEHPad() || LI.getLoopFor(&BB))
+            continue;
+        if (profiled && obfBlockHeat(BB, BFI, *PSI, HotPercentile_) == ObfHeat::Hot)
+            continue;
+        double perCall = entryFreq ? BFI.getBlockFreq(&BB).getFrequency() / entryFreq : 1.0;
+        candidates.push_back({&BB, std::min(perCall, 1.0), obfBlockCount(BB, BFI)});
+    }
+    // Fisher-Yates by hand: std::shuffle's sequence differs between
+    // standard libraries, and the output must not.
+    for (size_t i = candidates.size(); i > 1; --i)
+        std::swap(candidates[i - 1], candidates[rng() % i]);
+
     Type *I32 = Type::getInt32Ty(Ctx);
-    AllocaInst *cnt = headerBuilder.CreateAlloca(I32, nullptr, "fake_cnt");
-    headerBuilder.CreateStore(ConstantInt::get(I32, (rng() % 5) + 3), cnt); // Loop 3-7 times
-    headerBuilder.CreateBr(loopBody);
+    // An empty side-effecting asm keeps the optimizer from deleting the
+    // loop without costing an instruction.
+    InlineAsm *keep = InlineAsm::get(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                     "", "", /*hasSideEffects=*/true);
+    unsigned inserted = 0;
+    double spent = 0;
+    uint64_t overhead = 0;
+    for (const Candidate &C : candidates) {
+        if (inserted >= MaxLoops_)
+            break;
+        unsigned trips = (rng() % 5) + 3; // Loop 3-7 times
+        double cost = loopCost(trips) * C.PerCall;
+        if (spent + cost > Budget_)
+            continue;
+        spent += cost;
+        overhead += C.Count * loopCost(trips);
 
-    // 5. Populate the loop body (the part that repeats).
-    IRBuilder<> bodyBuilder(loopBody);
-    LoadInst *v = bodyBuilder.CreateLoad(I32, cnt, "fake_val");
-    Value *dec = bodyBuilder.CreateSub(v, ConstantInt::get(I32, 1), "fake_dec");
-    bodyBuilder.CreateStore(dec, cnt);
+        // 1. Split the block in front of its code: PHIs (and the entry's
+        //    static allocas) stay in the head, the rest moves after the loop.
+        BasicBlock *head = C.BB;
+        BasicBlock::iterator splitPoint = head->getFirstInsertionPt();
+        if (head == entryBlock)
+            while (isa<AllocaInst>(*splitPoint))
+                ++splitPoint;
+        BasicBlock *afterLoop = head->splitBasicBlock(splitPoint, "fake.loop.after");
+        BasicBlock *loopBody = BasicBlock::Create(Ctx, "fake.loop.body", &F, afterLoop);
+        head->getTerminator()->setSuccessor(0, loopBody);
 
-    Value *cond = bodyBuilder.CreateICmpSGT(dec, ConstantInt::get(I32, 0), "fake_cond");
-    bodyBuilder.CreateCondBr(cond, loopBody, afterLoop); // If condition is true, loop again; otherwise, exit to afterLoop.
+        // 2. The counter is an SSA value: a PHI counting down from trips.
+        IRBuilder<> bodyBuilder(loopBody);
+        PHINode *counter = bodyBuilder.CreatePHI(I32, 2, "fake_cnt");
+        counter->addIncoming(ConstantInt::get(I32, trips), head);
+        bodyBuilder.CreateCall(keep);
+        Value *dec = bodyBuilder.CreateSub(counter, ConstantInt::get(I32, 1), "fake_dec");
+        counter->addIncoming(dec, loopBody);
 
-    ++Inserted_;
-    errs() << "[FakeLoop] inserted " << Inserted_ << " loops\n";
-    
-    return PreservedAnalyses::none();
-}
\ No newline at end of file
+        Value *cond = bodyBuilder.CreateICmpSGT(dec, ConstantInt::get(I32, 0), "fake_cond");
+        BranchInst *latch = bodyBuilder.CreateCondBr(cond, loopBody, afterLoop); // If condition is true, loop again; otherwise, exit to afterLoop.
+        // The trip count is fixed, so the profile is exact: trips-1 back edges per
+        // exit. Block placement then lays the loop out as one straight run.
+        latch->setMetadata(LLVMContext::MD_prof,
+                           MDBuilder(Ctx).createBranchWeights(trips - 1, 1));
+        ++inserted;
+    }
+
+    if (inserted == 0)
+        return 0;
+
+    errs() << "[FakeLoop] inserted " << inserted << " loops in " << F.getName()
+           << format(" (~%.0f cycles per call)", spent) << "\n";
+    if (profiled)
+        obfReportOverhead("fake-loop", F, overhead, baseline);
+    Overhead += overhead;
+    return inserted;
+}
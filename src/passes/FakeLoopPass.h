@@ -2,17 +2,43 @@
 
 #include "llvm/IR/PassManager.h"
 #include <cstdint>
+#include <string>
+
+namespace llvm {
+class ProfileSummaryInfo;
+}
 
 // Declaration of the FakeLoopPass class
 class FakeLoopPass : public llvm::PassInfoMixin<FakeLoopPass> {
 private:
     uint32_t Seed_;
-    unsigned Inserted_;
+    unsigned Cycle_;
+    // Loops inserted per function, at most. LLVM_OBF_FAKE_LOOPS, default 1.
+    unsigned MaxLoops_;
+    // Estimated cycles per call the loops may add, each loop weighted by its
+    // block's static frequency relative to the entry.
+    // LLVM_OBF_FAKE_LOOP_BUDGET, default 32.
+    unsigned Budget_;
+    // Functions with fewer instructions (small leaves) get no loop.
+    // LLVM_OBF_FAKE_LOOP_MIN_INSTS, default 16.
+    unsigned MinInsts_;
+    // With profile data, functions whose entry is hot and hot blocks get no
+    // fake loop. LLVM_OBF_HOT_PERCENTILE.
+    unsigned HotPercentile_;
+    // OFILE, read at construction.
+    std::string StatsFile_;
+
+    // Inserts F's loops; returns how many, adding their estimated cycles
+    // (profile runs only) to Overhead.
+    unsigned runOnFunction(llvm::Function &F, llvm::FunctionAnalysisManager &AM,
+                           const llvm::ProfileSummaryInfo *PSI, uint64_t &Overhead) const;
 
 public:
     // Constructor
     FakeLoopPass();
+    // Round given by the pipeline (`fake-loop<cycle=N>`), not LLVM_OBF_CYCLE.
+    explicit FakeLoopPass(unsigned CycleIdx);
 
     // The main run method for the pass
-    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &AM);
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
 };
\ No newline at end of file
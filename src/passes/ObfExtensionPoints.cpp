@@ -0,0 +1,95 @@
+#include "ObfExtensionPoints.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdlib>
+#include <string>
+
+using namespace llvm;
+
+namespace {
+
+const char *const DoneTag = "obf.done";
+const char *const PreLinkTag = "obf.prelink";
+
+enum class EPMode { None, OptimizerLast, LTO };
+
+EPMode epMode() {
+  const char *env = std::getenv("LLVM_OBF_EP");
+  if (!env || !*env || StringRef(env) == "none")
+    return EPMode::None;
+  if (StringRef(env) == "optimizer-last")
+    return EPMode::OptimizerLast;
+  if (StringRef(env) == "lto")
+    return EPMode::LTO;
+  errs() << "[EP] unknown LLVM_OBF_EP=" << env << ", ignoring\n";
+  return EPMode::None;
+}
+
+std::string epPasses() {
+  const char *env = std::getenv("LLVM_OBF_EP_PASSES");
+  return env && *env ? env : "string-obf,bogus-insert,fake-loop,cff";
+}
+
+// Parses the pass list when the pipeline is built. A bad list is reported
+// and leaves the pipeline without obfuscation rather than aborting the build.
+void addObfuscation(PassBuilder &PB, ModulePassManager &MPM, bool SkipPreLink) {
+  ModulePassManager Inner;
+  if (Error Err = PB.parsePassPipeline(Inner, epPasses())) {
+    errs() << "[EP] LLVM_OBF_EP_PASSES: " << toString(std::move(Err)) << "\n";
+    return;
+  }
+  MPM.addPass(ObfExtensionPointPass(std::move(Inner), SkipPreLink));
+}
+
+} // namespace
+
+PreservedAnalyses ObfExtensionPointPass::run(Module &M,
+                                             ModuleAnalysisManager &AM) {
+  if (NamedMDNode *PreLink = M.getNamedMetadata(PreLinkTag)) {
+    M.eraseNamedMetadata(PreLink);
+    if (SkipPreLink)
+      return PreservedAnalyses::all();
+  }
+  if (M.getNamedMetadata(DoneTag))
+    return PreservedAnalyses::all();
+  errs() << "[EP] obfuscating " << M.getModuleIdentifier() << "\n";
+  PreservedAnalyses PA = Inner.run(M, AM);
+  M.getOrInsertNamedMetadata(DoneTag);
+  return PA;
+}
+
+PreservedAnalyses ObfMarkPreLinkPass::run(Module &M, ModuleAnalysisManager &) {
+  M.getOrInsertNamedMetadata(PreLinkTag);
+  return PreservedAnalyses::all();
+}
+
+void registerObfExtensionPoints(PassBuilder &PB) {
+  EPMode Mode = epMode();
+  if (Mode == EPMode::None)
+    return;
+  bool LTO = Mode == EPMode::LTO;
+  if (LTO)
+    PB.registerPipelineStartEPCallback(
+        [](ModulePassManager &MPM, OptimizationLevel) {
+          MPM.addPass(ObfMarkPreLinkPass());
+        });
+  // ThinLTO backends build the module optimization pipeline, which ends with
+  // this callback; in lto mode the tag skips it everywhere else.
+  PB.registerOptimizerLastEPCallback(
+      [&PB, LTO](ModulePassManager &MPM, OptimizationLevel) {
+        addObfuscation(PB, MPM, LTO);
+      });
+#if LLVM_VERSION_MAJOR >= 15
+  // The full LTO pipeline has no optimizer-last callback; LLVM 15 added one
+  // of its own. The module is the whole program there, so string pooling
+  // and the opaque-predicate state are shared by all translation units.
+  if (LTO)
+    PB.registerFullLinkTimeOptimizationLastEPCallback(
+        [&PB](ModulePassManager &MPM, OptimizationLevel) {
+          addObfuscation(PB, MPM, false);
+        });
+#endif
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class PassBuilder;
+} // namespace llvm
+
+// Obfuscation inside the default pipelines.
+//
+// Besides the textual names, the plugin can hook the pipelines clang and the
+// LTO linkers build, so `clang -fpass-plugin=libObfPasses.so` (or a linker
+// loading the plugin) obfuscates without a separate opt/llc chain. It is
+// configured like the passes, through the environment:
+//
+//   LLVM_OBF_EP         none (default): only the textual names.
+//                       optimizer-last: at the end of every optimization
+//                       pipeline, i.e. once per translation unit.
+//                       lto: only in link-time pipelines (ThinLTO backends,
+//                       and full LTO with LLVM 15 or later), so each module
+//                       is obfuscated once, after cross-module optimization.
+//   LLVM_OBF_EP_PASSES  pipeline run there, default
+//                       "string-obf,bogus-insert,fake-loop,cff".
+//
+// A module that has been through the hook is tagged with !obf.done and is
+// left alone by later hooks, e.g. a ThinLTO backend after a pre-link compile
+// with optimizer-last.
+void registerObfExtensionPoints(llvm::PassBuilder &PB);
+
+// Runs Inner unless the module is tagged !obf.done, then tags it. In lto
+// mode it also skips, once, modules tagged !obf.prelink.
+class ObfExtensionPointPass
+    : public llvm::PassInfoMixin<ObfExtensionPointPass> {
+public:
+  ObfExtensionPointPass(llvm::ModulePassManager Inner, bool SkipPreLink)
+      : Inner(std::move(Inner)), SkipPreLink(SkipPreLink) {}
+  llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+  static bool isRequired() { return true; }
+
+private:
+  llvm::ModulePassManager Inner;
+  bool SkipPreLink;
+};
+
+// Tags the module !obf.prelink. Added at the pipeline start, which the
+// pre-link and per-TU pipelines have and the link-time ones do not (LLVM 14
+// gives the optimizer-last callback no LTO phase).
+class ObfMarkPreLinkPass : public llvm::PassInfoMixin<ObfMarkPreLinkPass> {
+public:
+  llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+  static bool isRequired() { return true; }
+};
@@ -0,0 +1,104 @@
+#include "ObfMetrics.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdlib>
+
+using namespace llvm;
+
+AnalysisKey ObfMetricsAnalysis::Key;
+
+namespace {
+
+void accumulate(ObfFunctionMetrics &Into, const ObfFunctionMetrics &M) {
+  Into.Instructions += M.Instructions;
+  Into.Blocks += M.Blocks;
+  Into.Edges += M.Edges;
+  Into.Calls += M.Calls;
+  Into.Allocas += M.Allocas;
+  Into.Cyclomatic += M.Cyclomatic;
+}
+
+void writeFields(raw_ostream &OS, const ObfFunctionMetrics &M) {
+  OS << "{\"instructions\": " << M.Instructions << ", \"blocks\": " << M.Blocks
+     << ", \"edges\": " << M.Edges << ", \"calls\": " << M.Calls
+     << ", \"allocas\": " << M.Allocas << ", \"cyclomatic\": " << M.Cyclomatic
+     << "}";
+}
+
+} // namespace
+
+ObfFunctionMetrics obfFunctionMetrics(const Function &F) {
+  ObfFunctionMetrics M;
+  M.Name = F.getName().str();
+  for (const BasicBlock &BB : F) {
+    ++M.Blocks;
+    for (const Instruction &I : BB) {
+      ++M.Instructions;
+      if (isa<AllocaInst>(I))
+        ++M.Allocas;
+      else if (isa<CallBase>(I) && !isa<IntrinsicInst>(I))
+        ++M.Calls;
+    }
+    if (const Instruction *T = BB.getTerminator())
+      M.Edges += T->getNumSuccessors();
+  }
+  // Unreachable blocks can push E - N + 2 below 1; a function has at least
+  // one path.
+  if (M.Blocks)
+    M.Cyclomatic = M.Edges + 2 > M.Blocks ? M.Edges + 2 - M.Blocks : 1;
+  return M;
+}
+
+ObfModuleMetrics obfModuleMetrics(const Module &M) {
+  ObfModuleMetrics Result;
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    Result.Functions.push_back(obfFunctionMetrics(F));
+    accumulate(Result.Total, Result.Functions.back());
+  }
+  return Result;
+}
+
+void ObfModuleMetrics::writeJSON(raw_ostream &OS) const {
+  OS << "{\n  \"total\": ";
+  writeFields(OS, Total);
+  OS << ",\n  \"functions\": {";
+  for (size_t i = 0; i < Functions.size(); ++i) {
+    OS << (i ? ",\n    \"" : "\n    \"");
+    OS.write_escaped(Functions[i].Name);
+    OS << "\": ";
+    writeFields(OS, Functions[i]);
+  }
+  OS << (Functions.empty() ? "}\n" : "\n  }\n");
+  OS << "}\n";
+}
+
+ObfModuleMetrics ObfMetricsAnalysis::run(Module &M, ModuleAnalysisManager &) {
+  return obfModuleMetrics(M);
+}
+
+ObfMetricsPrinterPass::ObfMetricsPrinterPass() {
+  if (const char *of = std::getenv("OFILE"))
+    StatsFile = of;
+}
+
+PreservedAnalyses ObfMetricsPrinterPass::run(Module &M,
+                                             ModuleAnalysisManager &AM) {
+  const ObfModuleMetrics &Metrics = AM.getResult<ObfMetricsAnalysis>(M);
+  if (!StatsFile.empty()) {
+    std::error_code EC;
+    raw_fd_ostream os(StatsFile, EC);
+    if (EC) {
+      errs() << "[Metrics] cannot write " << StatsFile << ": " << EC.message() << "\n";
+      return PreservedAnalyses::all();
+    }
+    Metrics.writeJSON(os);
+  } else {
+    Metrics.writeJSON(outs());
+  }
+  return PreservedAnalyses::all();
+}
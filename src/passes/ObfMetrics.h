@@ -0,0 +1,65 @@
+#pragma once
+
+#include "llvm/IR/PassManager.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+// Size and shape metrics used by the before/after reports.
+//
+// Everything is gathered in one walk over each function's blocks, so a report
+// needs neither `opt -stats` nor any text parsing. The CLI links this file
+// directly and calls obfModuleMetrics(). Under opt, the `obf-metrics` pass
+// prints the same numbers as JSON.
+
+struct ObfFunctionMetrics {
+  std::string Name;
+  uint64_t Instructions = 0;
+  uint64_t Blocks = 0;
+  // CFG edges: the successors of every terminator.
+  uint64_t Edges = 0;
+  // call, invoke and callbr instructions, not counting intrinsics.
+  uint64_t Calls = 0;
+  uint64_t Allocas = 0;
+  // McCabe's E - N + 2.
+  uint64_t Cyclomatic = 0;
+};
+
+struct ObfModuleMetrics {
+  // Defined functions, in module order.
+  std::vector<ObfFunctionMetrics> Functions;
+  // Sums over Functions, cyclomatic complexity included.
+  ObfFunctionMetrics Total;
+
+  // {"total": {...}, "functions": {"name": {...}, ...}}
+  void writeJSON(llvm::raw_ostream &OS) const;
+};
+
+ObfFunctionMetrics obfFunctionMetrics(const llvm::Function &F);
+ObfModuleMetrics obfModuleMetrics(const llvm::Module &M);
+
+class ObfMetricsAnalysis : public llvm::AnalysisInfoMixin<ObfMetricsAnalysis> {
+  friend llvm::AnalysisInfoMixin<ObfMetricsAnalysis>;
+  static llvm::AnalysisKey Key;
+
+public:
+  using Result = ObfModuleMetrics;
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+};
+
+// `obf-metrics`: writes ObfMetricsAnalysis as JSON to OFILE, or to stdout
+// when OFILE is unset. Changes nothing.
+class ObfMetricsPrinterPass
+    : public llvm::PassInfoMixin<ObfMetricsPrinterPass> {
+public:
+  // Takes OFILE when constructed, like the obfuscation passes.
+  ObfMetricsPrinterPass();
+  llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+
+private:
+  std::string StatsFile;
+};
@@ -0,0 +1,101 @@
+#include "ObfUtils.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+using namespace llvm;
+
+namespace {
+
+// splitmix64 finalizer: a cheap bijective mixer with full avalanche.
+uint64_t mix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+} // namespace
+
+uint32_t obfGlobalSeed(uint32_t Default) {
+  if (const char *env = std::getenv("LLVM_OBF_SEED")) {
+    try {
+      return static_cast<uint32_t>(std::stoul(std::string(env)));
+    } catch (...) {
+      // Ignore malformed environment value and keep the default seed.
+    }
+  }
+  return Default;
+}
+
+unsigned obfCycle() {
+  if (const char *env = std::getenv("LLVM_OBF_CYCLE")) {
+    try {
+      return static_cast<unsigned>(std::stoul(std::string(env)));
+    } catch (...) {
+    }
+  }
+  return 0;
+}
+
+uint32_t obfDeriveSeed(uint32_t GlobalSeed, StringRef Symbol, StringRef PassId,
+                       unsigned Cycle) {
+  // xxHash64 is stable across hosts and LLVM builds, unlike std::hash.
+  uint64_t h = mix64(GlobalSeed);
+  h = mix64(h ^ xxHash64(PassId));
+  h = mix64(h ^ xxHash64(Symbol));
+  h = mix64(h ^ Cycle);
+  return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+unsigned obfHotPercentile() {
+  if (const char *env = std::getenv("LLVM_OBF_HOT_PERCENTILE")) {
+    try {
+      return std::min(100u, static_cast<unsigned>(std::stoul(std::string(env))));
+    } catch (...) {
+    }
+  }
+  return 90;
+}
+
+bool obfUseProfile(const ProfileSummaryInfo *PSI, unsigned Percentile) {
+  return PSI && Percentile && PSI->hasProfileSummary();
+}
+
+ObfHeat obfBlockHeat(const BasicBlock &BB, BlockFrequencyInfo &BFI,
+                     const ProfileSummaryInfo &PSI, unsigned Percentile) {
+  Optional<uint64_t> count = BFI.getBlockProfileCount(&BB);
+  if (!count || *count == 0)
+    return ObfHeat::Cold;
+  // Cutoffs are in parts per million of the total count.
+  if (PSI.isHotCountNthPercentile(Percentile * 10000, *count))
+    return ObfHeat::Hot;
+  return PSI.isColdCount(*count) ? ObfHeat::Cold : ObfHeat::Warm;
+}
+
+uint64_t obfBlockCount(const BasicBlock &BB, BlockFrequencyInfo &BFI) {
+  return BFI.getBlockProfileCount(&BB).getValueOr(0);
+}
+
+uint64_t obfDynamicInstructions(const Function &F, BlockFrequencyInfo &BFI) {
+  uint64_t total = 0;
+  for (const BasicBlock &BB : F)
+    total += obfBlockCount(BB, BFI) * BB.size();
+  return total;
+}
+
+void obfReportOverhead(StringRef PassId, const Function &F, uint64_t Cycles,
+                       uint64_t Baseline) {
+  errs() << "[PGO] " << PassId << " " << F.getName() << ": expected overhead "
+         << Cycles << " cycles over " << Baseline << " instructions";
+  if (Baseline)
+    errs() << format(" (%.1f%%)", 100.0 * Cycles / Baseline);
+  errs() << "\n";
+}
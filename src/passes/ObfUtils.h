@@ -0,0 +1,59 @@
+#pragma once
+
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+
+namespace llvm {
+class BasicBlock;
+class BlockFrequencyInfo;
+class Function;
+class ProfileSummaryInfo;
+} // namespace llvm
+
+// Seed derivation shared by the obfuscation passes.
+//
+// Every random choice a pass makes for one function (or one global) comes from
+// a generator seeded with obfDeriveSeed(global seed, symbol name, pass id,
+// cycle). The result depends only on those four values and not on the order
+// in which symbols are visited, so functions can be processed concurrently
+// and still give byte-identical output.
+
+// LLVM_OBF_SEED, or Default when it is unset or malformed.
+uint32_t obfGlobalSeed(uint32_t Default);
+
+// LLVM_OBF_CYCLE: index of the current round when a pass is applied several
+// times (0 when unset), so that repeated rounds make different choices.
+unsigned obfCycle();
+
+uint32_t obfDeriveSeed(uint32_t GlobalSeed, llvm::StringRef Symbol,
+                       llvm::StringRef PassId, unsigned Cycle);
+
+// Profile-guided intensity.
+//
+// When the module carries profile data (!prof metadata from clang's
+// -fprofile-instr-use / -fprofile-sample-use, or opt's pgo-instr-use), each
+// block is classed by its profile count. Hot blocks get little or no
+// obfuscation, Warm blocks a reduced amount and Cold blocks the full amount.
+// Without a profile every block is Cold, so the passes behave as before.
+enum class ObfHeat { Cold, Warm, Hot };
+
+// LLVM_OBF_HOT_PERCENTILE: blocks whose counts make up the hottest N percent
+// of the profile's total count are Hot (default 90; 0 turns PGO off).
+unsigned obfHotPercentile();
+
+// True when PSI has a profile summary and Percentile is not 0.
+bool obfUseProfile(const llvm::ProfileSummaryInfo *PSI, unsigned Percentile);
+
+ObfHeat obfBlockHeat(const llvm::BasicBlock &BB, llvm::BlockFrequencyInfo &BFI,
+                     const llvm::ProfileSummaryInfo &PSI, unsigned Percentile);
+
+// Profile count of BB (0 when unknown).
+uint64_t obfBlockCount(const llvm::BasicBlock &BB, llvm::BlockFrequencyInfo &BFI);
+
+// Profile-weighted instruction count of F, the baseline for overhead reports.
+uint64_t obfDynamicInstructions(const llvm::Function &F, llvm::BlockFrequencyInfo &BFI);
+
+// Prints the expected dynamic overhead PassId adds to F: Cycles estimated
+// extra cycles against Baseline dynamic instructions (about one cycle each).
+void obfReportOverhead(llvm::StringRef PassId, const llvm::Function &F,
+                       uint64_t Cycles, uint64_t Baseline);
@@ -1,51 +1,250 @@
 #include "StringObfPass.h" // Use the header for the declaration
+#include "ObfUtils.h"
 
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <map>
 #include <string>
 #include <vector>
 
 // Note: The 'using namespace' is fine, but the 'namespace llvm { ... }' wrapper is removed.
 using namespace llvm;
 
+namespace {
+
+// Everything needed to emit a decryption of one (unique) string literal.
+struct EncString {
+  Constant *EncPtr = nullptr;     // i8* to the ciphertext (unpooled)
+  GlobalVariable *Slot = nullptr; // decrypt-once cache slot (Once mode, unpooled)
+  uint32_t Len = 0;
+  uint32_t Key = 0;
+  uint64_t Offset = 0;            // position in the pool (pooled only)
+  uint64_t FlagOffset = 0;        // i32 once-flag in the pool cache (pooled Once)
+  uint64_t PlainOffset = 0;       // plaintext in the pool cache (pooled Once)
+};
+
+// Pool entries start on this boundary so the SIMD kernels see aligned data
+// and neighbouring strings pack into shared cache lines.
+const uint64_t PoolAlign = 16;
+
+// How one particular use gets its plaintext.
+enum class Strategy { Runtime, Once, Inline, Arena };
+
+// Keystream word i for the Stream cipher. Must stay bit-identical to
+// obf_ks_word() in src/runtime/decryptor.c.
+uint32_t keystreamWord(uint32_t key, uint32_t i) {
+  uint32_t x = key + i * 0x9E3779B9u;
+  x ^= x >> 16;
+  x += x << 3;
+  x ^= x >> 11;
+  x += x << 15;
+  x ^= x >> 13;
+  return x;
+}
+
+// Where code feeding operand U has to be inserted: right before the user, or
+// at the end of the incoming block when the user is a PHI node.
+Instruction *insertionPointFor(Use &U) {
+  auto *I = cast<Instruction>(U.getUser());
+  if (auto *PN = dyn_cast<PHINode>(I))
+    return PN->getIncomingBlock(U)->getTerminator();
+  return I;
+}
+
+// Rewrites constant-expression users of a string global (typically the
+// getelementptr(@str, 0, 0) clang emits for every literal) into instructions
+// placed right before their users, so that every remaining use is an
+// instruction operand that can be rewritten on its own. Users that are
+// global initializers are left alone.
+void expandConstantExprUsers(Constant *C) {
+  std::vector<ConstantExpr *> exprs;
+  for (User *U : C->users())
+    if (auto *CE = dyn_cast<ConstantExpr>(U))
+      exprs.push_back(CE);
+
+  for (ConstantExpr *CE : exprs) {
+    expandConstantExprUsers(CE);
+
+    std::vector<Use *> uses;
+    for (Use &U : CE->uses())
+      if (isa<Instruction>(U.getUser()))
+        uses.push_back(&U);
+    for (Use *U : uses)
+      U->set(CE->getAsInstruction(insertionPointFor(*U)));
+
+    if (CE->use_empty())
+      CE->destroyConstant();
+  }
+}
+
+// Library calls known to only read a string argument during the call and not
+// return or retain a pointer into it.
+bool isNonRetainingLibCall(StringRef Name) {
+  static const StringSet<> Known = {
+      "printf", "fprintf", "dprintf", "sprintf", "snprintf", "puts",
+      "fputs",  "perror",  "strcmp",  "strncmp", "strcasecmp", "strlen",
+      "memcmp", "fopen",   "open",    "getenv",  "atoi",   "atol",
+      "system"};
+  return Known.count(Name);
+}
+
+// True when the pointer flowing through U cannot outlive the current call
+// frame: it only reaches loads and non-capturing call arguments, possibly
+// through GEPs/bitcasts. Stack-backed plaintext is only legal for such uses.
+bool staysInFrame(Use &U, unsigned Depth = 0) {
+  auto *I = cast<Instruction>(U.getUser());
+  if (isa<LoadInst>(I))
+    return true;
+  if (auto *CB = dyn_cast<CallBase>(I)) {
+    if (!CB->isArgOperand(&U))
+      return false;
+    if (CB->doesNotCapture(CB->getArgOperandNo(&U)))
+      return true;
+    Function *Callee = CB->getCalledFunction();
+    return Callee && isNonRetainingLibCall(Callee->getName());
+  }
+  if ((isa<GetElementPtrInst>(I) || isa<BitCastInst>(I)) && Depth < 4) {
+    for (Use &Next : I->uses())
+      if (!staysInFrame(Next, Depth + 1))
+        return false;
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
 // Implementation of the constructor from your original code
-StringObfPass::StringObfPass() : Seed(0x12345678) {
-  if (const char *env = std::getenv("LLVM_OBF_SEED")) {
-    Seed = (uint32_t)std::stoul(env);
+StringObfPass::StringObfPass() : StringObfPass(obfCycle()) {}
+
+StringObfPass::StringObfPass(unsigned CycleIdx)
+    : Seed(obfGlobalSeed(0x12345678)), Cycle(CycleIdx),
+      Mode(DecryptMode::Runtime), CipherKind(Cipher::Byte), InlineMax(0),
+      InlineLoopMax(0), Hoist(true), Pool(false),
+      HotPercentile(obfHotPercentile()) {
+  if (const char *of = std::getenv("OFILE"))
+    StatsFile = of;
+  if (const char *env = std::getenv("LLVM_OBF_STRING_MODE")) {
+    std::string mode(env);
+    if (mode == "once") Mode = DecryptMode::Once;
+    else if (mode == "arena") Mode = DecryptMode::Arena;
+    else if (mode == "runtime") Mode = DecryptMode::Runtime;
+    else errs() << "[StringObf] unknown LLVM_OBF_STRING_MODE '" << mode
+                << "', using 'runtime'\n";
+  }
+  if (const char *env = std::getenv("LLVM_OBF_STRING_CIPHER")) {
+    std::string cipher(env);
+    if (cipher == "stream") CipherKind = Cipher::Stream;
+    else if (cipher == "byte") CipherKind = Cipher::Byte;
+    else errs() << "[StringObf] unknown LLVM_OBF_STRING_CIPHER '" << cipher
+                << "', using 'byte'\n";
+  }
+  if (const char *env = std::getenv("LLVM_OBF_STRING_INLINE_MAX")) {
+    try { InlineMax = (unsigned)std::stoul(env); } catch (...) {}
+  }
+  InlineLoopMax = InlineMax / 2;
+  if (const char *env = std::getenv("LLVM_OBF_STRING_INLINE_LOOP_MAX")) {
+    try { InlineLoopMax = (unsigned)std::stoul(env); } catch (...) {}
+  }
+  if (const char *env = std::getenv("LLVM_OBF_STRING_HOIST")) {
+    Hoist = std::string(env) != "0";
+  }
+  if (const char *env = std::getenv("LLVM_OBF_STRING_POOL")) {
+    Pool = std::string(env) != "0";
   }
 }
 
 // Implementation of the run method from your original code
 PreservedAnalyses StringObfPass::run(Module &M, ModuleAnalysisManager &AM) {
-  uint32_t current_seed = Seed;
   unsigned CountEncrypted = 0;
   uint64_t TotalBytes = 0;
+  unsigned CountInline = 0;
+  unsigned CountUses = 0;
+  unsigned CountCallSites = 0;
+  unsigned CountDeduplicated = 0;
+  unsigned CountGlobals = 0;
+  unsigned CountArena = 0;
+  unsigned CountArenaFunctions = 0;
+  unsigned CountHotSites = 0;
+  uint64_t TotalOverhead = 0;
+
+  // With a profile, hot sites use the Once cache even in the other modes,
+  // so the cache declarations and slots are needed then too.
+  ProfileSummaryInfo &PSI = AM.getResult<ProfileSummaryAnalysis>(M);
+  const bool profiled = obfUseProfile(&PSI, HotPercentile);
+  const bool cacheSlots = Mode != DecryptMode::Runtime || profiled;
 
-  auto next_key = [&]() -> uint32_t {
-    uint32_t x = current_seed;
-    x ^= x << 13;
-    x ^= x >> 17;
-    x ^= x << 5;
-    current_seed = x;
+  // Keyed on the global's name, so a string's key does not depend on how
+  // many strings precede it in the module.
+  auto key_for = [&](const GlobalVariable *GV) -> uint32_t {
+    uint32_t x = obfDeriveSeed(Seed, GV->getName(), "string-obf", Cycle);
     return x ? x : 0xdeadbeef;
   };
 
+  // Key byte XORed into plaintext byte i.
+  auto key_byte = [&](uint32_t key, size_t i) -> unsigned char {
+    if (CipherKind == Cipher::Stream)
+      return (unsigned char)(keystreamWord(key, (uint32_t)(i / 4)) >> (8 * (i % 4)));
+    return (unsigned char)(key & 0xFF);
+  };
+
   LLVMContext &Ctx = M.getContext();
+  Type *I8 = Type::getInt8Ty(Ctx);
+  Type *I8Ptr = Type::getInt8PtrTy(Ctx);
+  Type *I32 = Type::getInt32Ty(Ctx);
+  const char *suffix = CipherKind == Cipher::Stream ? "_ks" : "";
   FunctionCallee decryptor = M.getOrInsertFunction(
-      "__obf_decrypt",
-      FunctionType::get(Type::getInt8PtrTy(Ctx),
-                        {Type::getInt8PtrTy(Ctx), Type::getInt32Ty(Ctx),
-                         Type::getInt32Ty(Ctx)},
-                        false));
+      std::string("__obf_decrypt") + suffix,
+      FunctionType::get(I8Ptr, {I8Ptr, I32, I32}, false));
+  FunctionCallee decryptOnce;
+  // Arena mode falls back to decrypt-once for pointers that escape the frame.
+  if (cacheSlots && !Pool) {
+    decryptOnce = M.getOrInsertFunction(
+        std::string("__obf_decrypt_once") + suffix,
+        FunctionType::get(I8Ptr, {I8Ptr->getPointerTo(), I8Ptr, I32, I32},
+                          false));
+  } else if (cacheSlots) {
+    decryptOnce = M.getOrInsertFunction(
+        std::string("__obf_decrypt_into") + suffix,
+        FunctionType::get(I8Ptr, {I32->getPointerTo(), I8Ptr, I8Ptr, I32, I32},
+                          false));
+  }
+  FunctionCallee arenaBegin, arenaEnd, decryptArena;
+  if (Mode == DecryptMode::Arena) {
+    arenaBegin = M.getOrInsertFunction("__obf_arena_begin",
+                                       FunctionType::get(I8Ptr, false));
+    arenaEnd = M.getOrInsertFunction(
+        "__obf_arena_end",
+        FunctionType::get(Type::getVoidTy(Ctx), {I8Ptr}, false));
+    decryptArena = M.getOrInsertFunction(
+        std::string("__obf_decrypt_arena") + suffix,
+        FunctionType::get(I8Ptr, {I8Ptr, I32, I32}, false));
+  }
 
+  // --- Phase 1: encrypt every eligible literal ---
   std::vector<GlobalVariable *> globalsToProcess;
   for (GlobalVariable &GV : M.globals()) {
     globalsToProcess.push_back(&GV);
   }
 
+  std::vector<EncString> strings;
+  // Every replaced plaintext global and the index of its EncString. Without
+  // pooling this is 1:1; with pooling identical literals share one entry.
+  std::vector<std::pair<GlobalVariable *, size_t>> originals;
+  std::map<std::string, size_t> uniqueIdx;
+  std::string poolData;
   for (GlobalVariable *GV : globalsToProcess) {
     if (!GV->hasInitializer() || !GV->isConstant() ||
         !GV->hasPrivateLinkage())
@@ -55,61 +254,389 @@ PreservedAnalyses StringObfPass::run(Module &M, ModuleAnalysisManager &AM) {
       if (!CDA->isString())
         continue;
       StringRef s = CDA->getAsString();
-      if (s.size() <= 1)
+      // Only NUL-terminated literals: the terminator is dropped below. This
+      // also keeps a second cycle off the ciphertext of the first one.
+      if (s.size() <= 1 || s.back() != '\0' || GV->getName().endswith(".enc") ||
+          GV->getName().startswith("__obf_str_pool"))
         continue;
 
-      uint32_t key = next_key();
+      ++CountEncrypted;
+      if (Pool) {
+        auto known = uniqueIdx.find(s.str());
+        if (known != uniqueIdx.end()) {
+          originals.push_back({GV, known->second});
+          ++CountDeduplicated;
+          continue;
+        }
+        uniqueIdx[s.str()] = strings.size();
+      }
+
+      uint32_t key = key_for(GV);
       std::string enc;
       enc.resize(s.size() - 1);
-      unsigned char kb = static_cast<unsigned char>(key & 0xFF);
       for (size_t i = 0; i < s.size() - 1; ++i) {
-        enc[i] = static_cast<char>(s[i] ^ kb);
+        enc[i] = static_cast<char>(s[i] ^ key_byte(key, i));
       }
 
-      Constant *encInit = ConstantDataArray::getString(Ctx, enc, false);
-      GlobalVariable *encGV = new GlobalVariable(
-          M, encInit->getType(), true, GlobalValue::PrivateLinkage, encInit,
-          GV->getName() + ".enc");
-      encGV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+      EncString S;
+      S.Len = (uint32_t)enc.size();
+      S.Key = key;
+      if (Pool) {
+        // Reserve Len + 1 so the plaintext pool has room for the NUL.
+        S.Offset = poolData.size();
+        poolData += enc;
+        poolData.resize(alignTo(poolData.size() + 1, PoolAlign), '\0');
+      } else {
+        Constant *encInit = ConstantDataArray::getString(Ctx, enc, false);
+        GlobalVariable *encGV = new GlobalVariable(
+            M, encInit->getType(), true, GlobalValue::PrivateLinkage, encInit,
+            GV->getName() + ".enc");
+        encGV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+        S.EncPtr = ConstantExpr::getBitCast(encGV, I8Ptr);
+        ++CountGlobals;
+        if (cacheSlots) {
+          S.Slot = new GlobalVariable(
+              M, I8Ptr, false, GlobalValue::PrivateLinkage,
+              ConstantPointerNull::get(cast<PointerType>(I8Ptr)),
+              GV->getName() + ".slot");
+          S.Slot->setAlignment(Align(8));
+          ++CountGlobals;
+        }
+      }
+      originals.push_back({GV, strings.size()});
+      strings.push_back(S);
 
-      std::vector<User *> uses;
-      for (auto u : GV->users()) {
-        uses.push_back(u);
+      TotalBytes += enc.size();
+    }
+  }
+
+  // One ciphertext blob for the whole module, addressed by offset. In Once
+  // mode a second, zero-initialized blob (no file space) holds one once-flag
+  // per unique string followed by the plaintext, laid out like the pool.
+  GlobalVariable *poolGV = nullptr, *cacheGV = nullptr;
+  if (Pool && !strings.empty()) {
+    Constant *poolInit = ConstantDataArray::getString(Ctx, poolData, false);
+    poolGV = new GlobalVariable(M, poolInit->getType(), true,
+                                GlobalValue::PrivateLinkage, poolInit,
+                                "__obf_str_pool");
+    poolGV->setAlignment(Align(PoolAlign));
+    ++CountGlobals;
+    if (cacheSlots) {
+      uint64_t plainStart = alignTo(4 * strings.size(), PoolAlign);
+      for (size_t idx = 0; idx < strings.size(); ++idx) {
+        strings[idx].FlagOffset = 4 * idx;
+        strings[idx].PlainOffset = plainStart + strings[idx].Offset;
       }
+      auto *cacheTy = ArrayType::get(I8, plainStart + poolData.size());
+      cacheGV = new GlobalVariable(M, cacheTy, false, GlobalValue::PrivateLinkage,
+                                   ConstantAggregateZero::get(cacheTy),
+                                   "__obf_str_pool.cache");
+      cacheGV->setAlignment(Align(PoolAlign));
+      ++CountGlobals;
+    }
+  }
 
-      for (User *U : uses) {
-        if (auto *I = dyn_cast<Instruction>(U)) {
-          IRBuilder<> B(I);
-          Value *gep = B.CreateInBoundsGEP(
-              encGV->getValueType(), encGV,
-              {ConstantInt::get(Type::getInt32Ty(Ctx), 0),
-               ConstantInt::get(Type::getInt32Ty(Ctx), 0)});
-          Value *lenVal =
-              ConstantInt::get(Type::getInt32Ty(Ctx), (uint32_t)enc.size());
-          Value *keyVal = ConstantInt::get(Type::getInt32Ty(Ctx), (uint32_t)key);
-          CallInst *call = B.CreateCall(decryptor, {gep, lenVal, keyVal});
-          I->replaceUsesOfWith(GV, call);
+  // With pooling, each function takes the address of the pool (and cache)
+  // once, in its entry block, and reaches every string at an offset from it.
+  // The empty asm hides the global behind the copy so codegen cannot fold it
+  // back into each use: one relocation per function instead of one per use.
+  InlineAsm *launder = InlineAsm::get(FunctionType::get(I8Ptr, {I8Ptr}, false),
+                                      "", "=r,0", /*hasSideEffects=*/false);
+  Value *poolBase = nullptr, *cacheBase = nullptr;
+  auto baseOf = [&](Function &F, GlobalVariable *GV, Value *&Base) -> Value * {
+    if (!Base) {
+      BasicBlock &entry = F.getEntryBlock();
+      Base = IRBuilder<>(&entry, entry.getFirstInsertionPt())
+                 .CreateCall(launder, {ConstantExpr::getBitCast(GV, I8Ptr)},
+                             GV == poolGV ? "str.pool" : "str.cache");
+    }
+    return Base;
+  };
+  // Ciphertext of S, for code inserted by B.
+  auto encAddr = [&](IRBuilder<> &B, const EncString &S) -> Value * {
+    if (!Pool)
+      return S.EncPtr;
+    return B.CreateConstInBoundsGEP1_64(
+        I8, baseOf(*B.GetInsertBlock()->getParent(), poolGV, poolBase), S.Offset);
+  };
+
+  // --- Phase 2: group the instruction uses by function ---
+  std::map<Function *, std::vector<std::pair<Use *, size_t>>> usesByFunction;
+  for (auto &orig : originals) {
+    expandConstantExprUsers(orig.first);
+    for (Use &U : orig.first->uses()) {
+      if (auto *I = dyn_cast<Instruction>(U.getUser()))
+        usesByFunction[I->getFunction()].push_back({&U, orig.second});
+    }
+  }
+
+  // Decrypts S into a stack buffer right before InsertBefore: 8-byte volatile
+  // loads of the ciphertext XORed with compile-time key words. The volatile
+  // loads keep the optimizer from folding the plaintext back into .rodata.
+  auto emitInline = [&](Instruction *InsertBefore, AllocaInst *Buf,
+                        const EncString &S) -> Value * {
+    IRBuilder<> B(InsertBefore);
+    Value *src = encAddr(B, S);
+    Value *dst = B.CreateBitCast(Buf, I8Ptr);
+    uint32_t off = 0;
+    for (unsigned width : {8u, 4u, 2u, 1u}) {
+      Type *WTy = Type::getIntNTy(Ctx, width * 8);
+      for (; off + width <= S.Len; off += width) {
+        uint64_t mask = 0;
+        for (unsigned b = 0; b < width; ++b)
+          mask |= (uint64_t)key_byte(S.Key, off + b) << (8 * b);
+        Value *sp = B.CreateBitCast(B.CreateConstInBoundsGEP1_32(I8, src, off),
+                                    WTy->getPointerTo());
+        Value *dp = B.CreateBitCast(B.CreateConstInBoundsGEP1_32(I8, dst, off),
+                                    WTy->getPointerTo());
+        LoadInst *v = B.CreateAlignedLoad(WTy, sp, Align(1), true, "str.enc.w");
+        B.CreateAlignedStore(B.CreateXor(v, ConstantInt::get(WTy, mask)), dp,
+                             Align(1));
+      }
+    }
+    B.CreateStore(ConstantInt::get(I8, 0),
+                  B.CreateConstInBoundsGEP1_32(I8, dst, S.Len));
+    return dst;
+  };
+
+  // Emits the code producing the plaintext pointer for one use, in front of
+  // InsertBefore, and returns it.
+  auto emitDecrypt = [&](Instruction *InsertBefore, const EncString &S,
+                         Strategy St) -> Value * {
+    IRBuilder<> B(InsertBefore);
+    Value *gep = encAddr(B, S);
+    Value *lenVal = ConstantInt::get(I32, S.Len);
+    Value *keyVal = ConstantInt::get(I32, S.Key);
+    if (St == Strategy::Runtime)
+      return B.CreateCall(decryptor, {gep, lenVal, keyVal});
+    if (St == Strategy::Arena)
+      return B.CreateCall(decryptArena, {gep, lenVal, keyVal});
+
+    MDNode *unlikely = MDBuilder(Ctx).createBranchWeights(1, 1 << 20);
+    if (Pool) {
+      // Pooled Once: the plaintext sits at a fixed offset in the cache; only
+      // its once-flag (2 = ready) has to be checked before handing it out.
+      Value *cache = baseOf(*InsertBefore->getFunction(), cacheGV, cacheBase);
+      Value *ready = B.CreateBitCast(
+          B.CreateConstInBoundsGEP1_64(I8, cache, S.FlagOffset),
+          I32->getPointerTo());
+      Value *plainPtr = B.CreateConstInBoundsGEP1_64(I8, cache, S.PlainOffset);
+      LoadInst *state = B.CreateAlignedLoad(I32, ready, Align(4), "str.ready");
+      state->setAtomic(AtomicOrdering::Acquire);
+      Value *missing = B.CreateICmpNE(state, ConstantInt::get(I32, 2));
+      Instruction *slowTerm =
+          SplitBlockAndInsertIfThen(missing, InsertBefore, false, unlikely);
+      slowTerm->getParent()->setName("str.decrypt.once");
+      IRBuilder<> SB(slowTerm);
+      SB.CreateCall(decryptOnce, {ready, plainPtr, gep, lenVal, keyVal});
+      return plainPtr;
+    }
+
+    // Once: fast path is a single acquire load of the slot; only the first
+    // use (per slot) takes the cold branch into the runtime.
+    LoadInst *cached = B.CreateAlignedLoad(I8Ptr, S.Slot, Align(8), "str.cached");
+    cached->setAtomic(AtomicOrdering::Acquire);
+    Value *missing = B.CreateIsNull(cached);
+    Instruction *slowTerm =
+        SplitBlockAndInsertIfThen(missing, InsertBefore, false, unlikely);
+    BasicBlock *slowBB = slowTerm->getParent();
+    slowBB->setName("str.decrypt.once");
+    IRBuilder<> SB(slowTerm);
+    CallInst *fresh = SB.CreateCall(decryptOnce, {S.Slot, gep, lenVal, keyVal});
+    IRBuilder<> TB(InsertBefore->getParent(), InsertBefore->getParent()->begin());
+    PHINode *plain = TB.CreatePHI(I8Ptr, 2, "str.plain");
+    plain->addIncoming(cached, cached->getParent());
+    plain->addIncoming(fresh, slowBB);
+    return plain;
+  };
+
+  // --- Phase 3: rewrite the uses function by function ---
+  FunctionAnalysisManager &FAM =
+      AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  for (Function &F : M) {
+    auto found = usesByFunction.find(&F);
+    if (found == usesByFunction.end())
+      continue;
+    poolBase = cacheBase = nullptr;
+
+    // One decryption site: a set of uses of the same string that share the
+    // plaintext produced at InsertBefore. Every site is planned up front,
+    // while the dominator tree and LoopInfo still match the CFG.
+    struct Site {
+      size_t Idx;
+      std::vector<Use *> Uses;
+      Instruction *InsertBefore = nullptr;
+      Strategy St = Strategy::Runtime;
+    };
+    DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+    BlockFrequencyInfo *BFI =
+        profiled ? &FAM.getResult<BlockFrequencyAnalysis>(F) : nullptr;
+    uint64_t baseline = BFI ? obfDynamicInstructions(F, *BFI) : 0;
+    uint64_t overhead = 0;
+    // Arena release is emitted in front of every return, which would break a
+    // musttail call/ret pair; such functions use decrypt-once instead.
+    bool arenaOK = Mode == DecryptMode::Arena;
+    for (BasicBlock &BB : F)
+      if (BB.getTerminatingMustTailCall())
+        arenaOK = false;
+    std::vector<Site> sites;
+    std::map<size_t, size_t> siteOf;
+    for (auto &entry : found->second) {
+      // Uses in unreachable code have no dominator to share; keep them apart.
+      bool share = Hoist && DT.isReachableFromEntry(
+                                insertionPointFor(*entry.first)->getParent());
+      auto known = siteOf.find(entry.second);
+      if (share && known != siteOf.end()) {
+        sites[known->second].Uses.push_back(entry.first);
+        continue;
+      }
+      if (share)
+        siteOf[entry.second] = sites.size();
+      sites.push_back(Site());
+      sites.back().Idx = entry.second;
+      sites.back().Uses.push_back(entry.first);
+    }
+
+    for (Site &site : sites) {
+      const EncString &S = strings[site.Idx];
+
+      // Nearest block dominating every use, then out of any enclosing loop.
+      BasicBlock *BB = insertionPointFor(*site.Uses.front())->getParent();
+      for (Use *U : site.Uses)
+        if (U != site.Uses.front())
+          BB = DT.findNearestCommonDominator(BB, insertionPointFor(*U)->getParent());
+      if (Hoist && DT.isReachableFromEntry(BB)) {
+        while (Loop *L = LI.getLoopFor(BB)) {
+          if (BasicBlock *pre = L->getLoopPreheader())
+            BB = pre;
+          else
+            BB = DT.getNode(L->getHeader())->getIDom()->getBlock();
+        }
+      }
+      // Insert before the first use in that block, else at its end.
+      site.InsertBefore = BB->getTerminator();
+      for (Instruction &I : *BB) {
+        bool isUsePoint = false;
+        for (Use *U : site.Uses)
+          isUsePoint |= insertionPointFor(*U) == &I;
+        if (isUsePoint) {
+          site.InsertBefore = &I;
+          break;
         }
       }
 
-      if (GV->use_empty()) {
-        GV->eraseFromParent();
+      site.St = Mode == DecryptMode::Runtime ? Strategy::Runtime : Strategy::Once;
+      bool inFrame = true;
+      for (Use *U : site.Uses)
+        inFrame = inFrame && staysInFrame(*U);
+      // Arena memory is only reclaimed on return, so a decryption left inside
+      // a loop would grow the arena every iteration.
+      if (inFrame && arenaOK && !LI.getLoopFor(BB))
+        site.St = Strategy::Arena;
+      if (inFrame && S.Len <= InlineMax) {
+        // In a loop the inline XOR re-runs each iteration; that still beats a
+        // malloc per iteration, but not the Once mode's single load.
+        bool inLoop = LI.getLoopFor(BB);
+        if (!inLoop || Mode != DecryptMode::Once || S.Len <= InlineLoopMax)
+          site.St = Strategy::Inline;
       }
 
-      ++CountEncrypted;
-      TotalBytes += enc.size();
+      // Hot sites: a runtime call or arena per execution is too costly.
+      if (BFI && (site.St == Strategy::Runtime || site.St == Strategy::Arena) &&
+          obfBlockHeat(*BB, *BFI, PSI, HotPercentile) == ObfHeat::Hot) {
+        site.St = Strategy::Once;
+        ++CountHotSites;
+      }
+      // Estimated cycles per execution: call plus allocation for Runtime,
+      // a bump allocation for Arena, one load for Once and two ops per
+      // 8-byte word for Inline.
+      if (BFI) {
+        uint64_t cost = site.St == Strategy::Runtime ? 40 + S.Len
+                      : site.St == Strategy::Arena   ? 12 + S.Len
+                      : site.St == Strategy::Once    ? 3
+                                                     : 2 * (S.Len / 8 + 1);
+        overhead += obfBlockCount(*BB, *BFI) * cost;
+      }
+    }
+
+    IRBuilder<> EntryB(&F.getEntryBlock(), F.getEntryBlock().begin());
+
+    // One arena per activation: take a mark on entry, release it (which also
+    // zeroes everything decrypted since) in front of every return.
+    Value *arenaMark = nullptr;
+    for (Site &site : sites) {
+      if (site.St != Strategy::Arena || arenaMark)
+        continue;
+      BasicBlock &entry = F.getEntryBlock();
+      arenaMark = IRBuilder<>(&entry, entry.getFirstInsertionPt())
+                      .CreateCall(arenaBegin, {}, "str.arena");
+      for (BasicBlock &BB : F)
+        if (auto *RI = dyn_cast<ReturnInst>(BB.getTerminator()))
+          IRBuilder<>(RI).CreateCall(arenaEnd, {arenaMark});
+      ++CountArenaFunctions;
+      if (BFI)
+        overhead += obfBlockCount(entry, *BFI) * 10;
     }
+
+    for (Site &site : sites) {
+      const EncString &S = strings[site.Idx];
+      Value *plain;
+      if (site.St == Strategy::Inline) {
+        AllocaInst *buf = EntryB.CreateAlloca(ArrayType::get(I8, S.Len + 1),
+                                              nullptr, "str.stack");
+        plain = emitInline(site.InsertBefore, buf, S);
+        ++CountInline;
+      } else {
+        plain = emitDecrypt(site.InsertBefore, S, site.St);
+        ++CountCallSites;
+        if (site.St == Strategy::Arena)
+          ++CountArena;
+      }
+      // Cast back to the type each use had (the original global's type).
+      IRBuilder<> B(site.InsertBefore);
+      for (Use *U : site.Uses)
+        U->set(B.CreateBitCast(plain, U->get()->getType()));
+      CountUses += site.Uses.size();
+    }
+    if (BFI) {
+      obfReportOverhead("string-obf", F, overhead, baseline);
+      TotalOverhead += overhead;
+    }
+    FAM.invalidate(F, PreservedAnalyses::none());
+  }
+
+  if (CountUses > CountCallSites) {
+    errs() << "[StringObf] eliminated " << CountUses - CountCallSites
+           << " runtime decrypt calls\n";
   }
 
-  if (const char *of = std::getenv("OFILE")) {
+  for (auto &orig : originals) {
+    if (orig.first->use_empty()) {
+      orig.first->eraseFromParent();
+    }
+  }
+
+  if (!StatsFile.empty()) {
     std::error_code EC;
-    raw_fd_ostream os(of, EC);
+    raw_fd_ostream os(StatsFile, EC);
     if (!EC) {
       os << "{\n";
       os << "  \"num_strings_encrypted\": " << CountEncrypted << ",\n";
-      os << "  \"total_string_bytes\": " << TotalBytes << "\n";
+      os << "  \"total_string_bytes\": " << TotalBytes << ",\n";
+      os << "  \"num_inline_decryptions\": " << CountInline << ",\n";
+      os << "  \"num_decrypt_uses\": " << CountUses << ",\n";
+      os << "  \"num_runtime_decrypt_calls\": " << CountCallSites << ",\n";
+      os << "  \"num_runtime_calls_eliminated\": " << CountUses - CountCallSites << ",\n";
+      os << "  \"num_strings_deduplicated\": " << CountDeduplicated << ",\n";
+      os << "  \"num_string_globals\": " << CountGlobals << ",\n";
+      os << "  \"pool_bytes\": " << poolData.size() << ",\n";
+      os << "  \"num_arena_decryptions\": " << CountArena << ",\n";
+      os << "  \"num_arena_functions\": " << CountArenaFunctions << ",\n";
+      os << "  \"num_hot_sites_cached\": " << CountHotSites << ",\n";
+      os << "  \"expected_overhead_cycles\": " << TotalOverhead << "\n";
       os << "}\n";
     }
   }
-  return PreservedAnalyses::all();
-}
\ No newline at end of file
+  return CountEncrypted ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
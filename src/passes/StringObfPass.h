@@ -2,13 +2,59 @@
 
 #include "llvm/IR/PassManager.h"
 #include <cstdint>
+#include <string>
 
 // NOTE: The class is now in the global namespace
 class StringObfPass : public llvm::PassInfoMixin<StringObfPass> {
+public:
+    // How a use of an encrypted string obtains its plaintext.
+    //  Runtime: call __obf_decrypt at every use (fresh heap buffer each time).
+    //  Once:    decrypt on first use into a per-string slot; later uses load
+    //           the cached pointer without calling into the runtime.
+    //  Arena:   decrypt into a per-activation arena (thread-local slab in the
+    //           runtime) that is released and zeroed on every return path;
+    //           pointers that may escape the function use Once instead.
+    // Selected with LLVM_OBF_STRING_MODE=runtime|once|arena.
+    enum class DecryptMode { Runtime, Once, Arena };
+
+    // How the ciphertext is produced.
+    //  Byte:   every byte XORed with the low byte of the key (legacy).
+    //  Stream: XOR with a 32-bit counter-based keystream derived from the full
+    //          key, decoded by the runtime's SSE2/AVX2 kernels.
+    // Selected with LLVM_OBF_STRING_CIPHER=byte|stream.
+    enum class Cipher { Byte, Stream };
+
 private:
     uint32_t Seed;
+    unsigned Cycle;
+    DecryptMode Mode;
+    Cipher CipherKind;
+    // Strings of at most this many bytes may be decrypted inline into a stack
+    // buffer (no runtime call, no heap). 0 disables inline decryption.
+    // LLVM_OBF_STRING_INLINE_MAX.
+    unsigned InlineMax;
+    // Inside loops the inline sequence re-runs every iteration, so with the
+    // Once mode only strings up to this length are inlined there.
+    // LLVM_OBF_STRING_INLINE_LOOP_MAX (default InlineMax / 2).
+    unsigned InlineLoopMax;
+    // Share one decryption per string per function, placed at the nearest
+    // common dominator of its uses and hoisted out of loops, instead of one
+    // decryption in front of every use. LLVM_OBF_STRING_HOIST=0 disables it.
+    bool Hoist;
+    // Deduplicate identical literals and pack all ciphertext into a single
+    // aligned __obf_str_pool blob addressed by offset (one symbol instead of
+    // one .enc global per string). LLVM_OBF_STRING_POOL=1.
+    bool Pool;
+    // With profile data, decryptions in hot blocks use the Once strategy
+    // (one load per use after the first) instead of a runtime call or an
+    // arena. LLVM_OBF_HOT_PERCENTILE.
+    unsigned HotPercentile;
+    // OFILE, read at construction.
+    std::string StatsFile;
 
 public:
     StringObfPass();
+    // Round given by the pipeline (`string-obf<cycle=N>`), not LLVM_OBF_CYCLE.
+    explicit StringObfPass(unsigned CycleIdx);
     llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
-};
\ No newline at end of file
+};
@@ -7,39 +7,68 @@
 #include "BogusInsertPass.h"
 #include "ControlFlowFlatteningPass.h"
 #include "FakeLoopPass.h" // <-- ADD THIS INCLUDE
+#include "ObfExtensionPoints.h"
+#include "ObfMetrics.h"
+#include "ObfUtils.h"
 
 using namespace llvm;
 
+// Matches `Pass` or `Pass<cycle=N>`. The parameter takes the place of
+// LLVM_OBF_CYCLE, so pipelines running side by side on several threads can
+// use different rounds without touching the shared environment.
+static bool matchObfPass(StringRef Name, StringRef Pass, unsigned &Cycle) {
+    if (Name == Pass) {
+        Cycle = obfCycle();
+        return true;
+    }
+    if (!Name.consume_front(Pass) || !Name.consume_front("<cycle=") ||
+        !Name.consume_back(">"))
+        return false;
+    return !Name.getAsInteger(10, Cycle);
+}
+
 // This is now the ONLY file with llvmGetPassPluginInfo
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
 llvmGetPassPluginInfo() {
     return {
         LLVM_PLUGIN_API_VERSION, "ObfPasses", "v0.1",
         [](PassBuilder &PB) {
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                    MAM.registerPass([] { return ObfMetricsAnalysis(); });
+                }
+            );
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                    if (Name == "string-obf") {
-                        MPM.addPass(StringObfPass());
+                    unsigned Cycle;
+                    if (matchObfPass(Name, "string-obf", Cycle)) {
+                        MPM.addPass(StringObfPass(Cycle));
                         return true;
                     }
-                    if (Name == "bogus-insert") {
-                        MPM.addPass(BogusInsertPass());
+                    if (matchObfPass(Name, "bogus-insert", Cycle)) {
+                        MPM.addPass(BogusInsertPass(Cycle));
                         return true;
                     }
-                    if (Name == "cff") {
-                        MPM.addPass(createModuleToFunctionPassAdaptor(ControlFlowFlatteningPass()));
+                    if (matchObfPass(Name, "cff", Cycle)) {
+                        MPM.addPass(ControlFlowFlatteningPass(Cycle));
                         return true;
                     }
                     // --- ADD THIS BLOCK TO REGISTER THE FAKE LOOP PASS ---
-                    if (Name == "fake-loop") {
-                        MPM.addPass(createModuleToFunctionPassAdaptor(FakeLoopPass()));
+                    if (matchObfPass(Name, "fake-loop", Cycle)) {
+                        MPM.addPass(FakeLoopPass(Cycle));
                         return true;
                     }
                     // --- END OF ADDED BLOCK ---
+                    if (Name == "obf-metrics") {
+                        MPM.addPass(ObfMetricsPrinterPass());
+                        return true;
+                    }
                     return false;
                 }
             );
+            // Hooks into clang's and the LTO linkers' pipelines (LLVM_OBF_EP).
+            registerObfExtensionPoints(PB);
         }
     };
 }
\ No newline at end of file
@@ -6,45 +6,373 @@
 #if defined(_WIN32) || defined(_WIN64)
   #include <windows.h>
   #define NOINLINE __declspec(noinline)
+  #define OBF_TLS __declspec(thread)
   typedef CRITICAL_SECTION obf_mutex_t;
-  static void obf_mutex_init(obf_mutex_t *m) { InitializeCriticalSection(m); }
-  static void obf_mutex_lock(obf_mutex_t *m) { EnterCriticalSection(m); }
-  static void obf_mutex_unlock(obf_mutex_t *m) { LeaveCriticalSection(m); }
+  static inline void obf_mutex_init(obf_mutex_t *m) { InitializeCriticalSection(m); }
+  static inline void obf_mutex_lock(obf_mutex_t *m) { EnterCriticalSection(m); }
+  static inline void obf_mutex_unlock(obf_mutex_t *m) { LeaveCriticalSection(m); }
+  static inline char *obf_load_acquire(char **p) { return (char*)InterlockedCompareExchangePointer((PVOID volatile*)p, NULL, NULL); }
+  static inline int obf_load_acquire_int(int *p) { return (int)InterlockedCompareExchange((LONG volatile*)p, 0, 0); }
+  static inline void obf_store_release_int(int *p, int v) { InterlockedExchange((LONG volatile*)p, v); }
+  static inline int obf_cas_int(int *p, int expected, int desired) {
+      return InterlockedCompareExchange((LONG volatile*)p, desired, expected) == expected;
+  }
+  static inline void obf_cpu_relax(void) { YieldProcessor(); }
+  static inline int obf_cas_ptr(char **p, char *expected, char *desired) {
+      return InterlockedCompareExchangePointer((PVOID volatile*)p, desired, expected) == expected;
+  }
+  /* thread-exit hook for the string arenas (fiber-local storage callback) */
+  typedef DWORD obf_tls_key_t;
+  static inline void obf_tls_key_create(obf_tls_key_t *k, void (*dtor)(void *)) {
+      *k = FlsAlloc((PFLS_CALLBACK_FUNCTION)dtor);
+  }
+  static inline void obf_tls_key_arm(obf_tls_key_t k) { FlsSetValue(k, (PVOID)1); }
+  static inline void obf_secure_zero(void *p, size_t n) { SecureZeroMemory(p, n); }
 #else
   #include <pthread.h>
+  #include <sched.h>
   #define NOINLINE __attribute__((noinline))
+  #define OBF_TLS __thread
   typedef pthread_mutex_t obf_mutex_t;
-  static void obf_mutex_init(obf_mutex_t *m) { pthread_mutex_init(m, NULL); }
-  static void obf_mutex_lock(obf_mutex_t *m) { pthread_mutex_lock(m); }
-  static void obf_mutex_unlock(obf_mutex_t *m) { pthread_mutex_unlock(m); }
+  static inline void obf_mutex_init(obf_mutex_t *m) { pthread_mutex_init(m, NULL); }
+  static inline void obf_mutex_lock(obf_mutex_t *m) { pthread_mutex_lock(m); }
+  static inline void obf_mutex_unlock(obf_mutex_t *m) { pthread_mutex_unlock(m); }
+  static inline char *obf_load_acquire(char **p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+  static inline int obf_load_acquire_int(int *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+  static inline void obf_store_release_int(int *p, int v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+  static inline int obf_cas_int(int *p, int expected, int desired) {
+      return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  }
+  static inline void obf_cpu_relax(void) { sched_yield(); }
+  static inline int obf_cas_ptr(char **p, char *expected, char *desired) {
+      return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  }
+  typedef pthread_key_t obf_tls_key_t;
+  static inline void obf_tls_key_create(obf_tls_key_t *k, void (*dtor)(void *)) { pthread_key_create(k, dtor); }
+  static inline void obf_tls_key_arm(obf_tls_key_t k) { pthread_setspecific(k, (void*)1); }
+  /* Plain memset so libc's vector stores do the work; the empty asm makes the
+   * buffer observable so the stores cannot be dropped as dead. */
+  static inline void obf_secure_zero(void *p, size_t n) {
+      memset(p, 0, n);
+      __asm__ __volatile__("" : : "r"(p) : "memory");
+  }
 #endif
 
-static void secure_zero(void *p, size_t n) {
-    volatile unsigned char *vp = (volatile unsigned char*)p;
-    while (n--) *vp++ = 0;
+/* The decrypt path only reads the immutable ciphertext and writes a buffer
+ * owned by the calling thread, so it needs no lock. Build with
+ * -DOBF_RUNTIME_SERIALIZED to get the old behaviour where every decryption
+ * is serialized on one global mutex (kept for comparison benchmarks). */
+#ifdef OBF_RUNTIME_SERIALIZED
+static obf_mutex_t obf_mutex;
+  #define OBF_DECRYPT_LOCK()   obf_mutex_lock(&obf_mutex)
+  #define OBF_DECRYPT_UNLOCK() obf_mutex_unlock(&obf_mutex)
+#else
+  #define OBF_DECRYPT_LOCK()   ((void)0)
+  #define OBF_DECRYPT_UNLOCK() ((void)0)
+#endif
+
+/* ---- Ciphers ------------------------------------------------------------
+ * OBF_CIPHER_BYTE:   every byte XORed with (key & 0xFF) (legacy).
+ * OBF_CIPHER_STREAM: byte j XORed with byte (j % 4) of obf_ks_word(key, j / 4),
+ *                    little-endian. The word function is add/xor/shift only so
+ *                    it maps 1:1 onto SSE2/AVX2 32-bit lanes. StringObfPass
+ *                    (keystreamWord) must stay bit-identical to it. */
+enum { OBF_CIPHER_BYTE = 0, OBF_CIPHER_STREAM = 1 };
+
+#define OBF_KS_STEP 0x9E3779B9u
+
+static inline uint32_t obf_ks_mix(uint32_t x) {
+    x ^= x >> 16;
+    x += x << 3;
+    x ^= x >> 11;
+    x += x << 15;
+    x ^= x >> 13;
+    return x;
 }
 
-static obf_mutex_t obf_mutex;
+static inline uint32_t obf_ks_word(uint32_t key, uint32_t i) {
+    return obf_ks_mix(key + i * OBF_KS_STEP);
+}
 
-NOINLINE char *__obf_decrypt(char *enc_ptr, int len, int key) {
+static void obf_xor_byte(char *dst, const char *src, size_t len, uint32_t key) {
+    unsigned char k = (unsigned char)(key & 0xFF);
+    for (size_t i = 0; i < len; ++i)
+        dst[i] = (char)((unsigned char)src[i] ^ k);
+}
+
+/* Scalar keystream kernel; also finishes the tail for the vector kernels,
+ * starting at byte offset `from` (a multiple of 4). */
+static void obf_xor_stream_scalar_from(char *dst, const char *src, size_t len,
+                                       uint32_t key, size_t from) {
+    size_t i = from;
+    for (; i + 4 <= len; i += 4) {
+        uint32_t w = obf_ks_word(key, (uint32_t)(i / 4)), v;
+        memcpy(&v, src + i, 4);
+        v ^= w; /* little-endian byte order matches the pass */
+        memcpy(dst + i, &v, 4);
+    }
+    if (i < len) {
+        uint32_t w = obf_ks_word(key, (uint32_t)(i / 4));
+        for (; i < len; ++i, w >>= 8)
+            dst[i] = (char)((unsigned char)src[i] ^ (unsigned char)w);
+    }
+}
+
+static void obf_xor_stream_scalar(char *dst, const char *src, size_t len, uint32_t key) {
+    obf_xor_stream_scalar_from(dst, src, len, key, 0);
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+  #define OBF_HAVE_X86_KERNELS 1
+  #include <immintrin.h>
+
+__attribute__((target("sse2")))
+static void obf_xor_stream_sse2(char *dst, const char *src, size_t len, uint32_t key) {
+    size_t i = 0;
+    __m128i ctr  = _mm_add_epi32(_mm_set1_epi32((int)key),
+                                 _mm_setr_epi32(0, (int)OBF_KS_STEP, (int)(2 * OBF_KS_STEP),
+                                                (int)(3 * OBF_KS_STEP)));
+    __m128i step = _mm_set1_epi32((int)(4 * OBF_KS_STEP));
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = ctr;
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+        x = _mm_add_epi32(x, _mm_slli_epi32(x, 3));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 11));
+        x = _mm_add_epi32(x, _mm_slli_epi32(x, 15));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 13));
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, x));
+        ctr = _mm_add_epi32(ctr, step);
+    }
+    obf_xor_stream_scalar_from(dst, src, len, key, i);
+}
+
+__attribute__((target("avx2")))
+static void obf_xor_stream_avx2(char *dst, const char *src, size_t len, uint32_t key) {
+    size_t i = 0;
+    __m256i ctr  = _mm256_add_epi32(_mm256_set1_epi32((int)key),
+                                    _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                                       _mm256_set1_epi32((int)OBF_KS_STEP)));
+    __m256i step = _mm256_set1_epi32((int)(8 * OBF_KS_STEP));
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = ctr;
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+        x = _mm256_add_epi32(x, _mm256_slli_epi32(x, 3));
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 11));
+        x = _mm256_add_epi32(x, _mm256_slli_epi32(x, 15));
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 13));
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, x));
+        ctr = _mm256_add_epi32(ctr, step);
+    }
+    obf_xor_stream_scalar_from(dst, src, len, key, i);
+}
+#endif
+
+typedef void (*obf_xor_fn)(char *, const char *, size_t, uint32_t);
+
+/* Picks the widest keystream kernel the CPU supports. The result only depends
+ * on the CPU, so a racing first call from several threads is harmless. */
+static obf_xor_fn obf_select_stream_kernel(void) {
+#ifdef OBF_HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return obf_xor_stream_avx2;
+    if (__builtin_cpu_supports("sse2")) return obf_xor_stream_sse2;
+#endif
+    return obf_xor_stream_scalar;
+}
+
+static obf_xor_fn obf_stream_kernel;
+
+static void obf_decode(char *dst, const char *src, size_t len, uint32_t key, int cipher) {
+    if (cipher == OBF_CIPHER_STREAM) {
+        obf_xor_fn fn = obf_stream_kernel;
+        if (!fn) fn = obf_stream_kernel = obf_select_stream_kernel();
+        fn(dst, src, len, key);
+    } else {
+        obf_xor_byte(dst, src, len, key);
+    }
+}
+
+static char *obf_decrypt_with(char *enc_ptr, int len, int key, int cipher) {
     if (len <= 0 || !enc_ptr) return NULL;
     char *buf = (char*)malloc((size_t)len + 1);
     if (!buf) return NULL;
-    unsigned char k = (unsigned char)(key & 0xFF);
-    obf_mutex_lock(&obf_mutex);
-    for (int i = 0; i < len; ++i) {
-        volatile unsigned char v = (volatile unsigned char)enc_ptr[i];
-        volatile unsigned char d = (volatile unsigned char)(v ^ k);
-        buf[i] = (char)d;
+    OBF_DECRYPT_LOCK();
+    obf_decode(buf, enc_ptr, (size_t)len, (uint32_t)key, cipher);
+    OBF_DECRYPT_UNLOCK();
+    buf[len] = '\0';
+    return buf;
+}
+
+/* Decrypt-once core used by StringObfPass in "once" mode. The slot is the
+ * per-string cache; a non-NULL value means the plaintext is published.
+ * Threads racing on the first use each decrypt, one wins the CAS and the
+ * losers free their copy, so memory stays bounded at one buffer per string. */
+static char *obf_decrypt_once_with(char **slot, char *enc_ptr, int len, int key, int cipher) {
+    char *cur = obf_load_acquire(slot);
+    if (cur) return cur;
+    char *buf = obf_decrypt_with(enc_ptr, len, key, cipher);
+    if (!buf) return NULL;
+    if (!obf_cas_ptr(slot, NULL, buf)) {
+        free(buf);
+        return obf_load_acquire(slot);
+    }
+    return buf;
+}
+
+/* Pooled decrypt-once: StringObfPass with LLVM_OBF_STRING_POOL=1 lays the
+ * plaintext cache out exactly like the ciphertext pool, so `dst` is a fixed
+ * slice of a zero-initialized global and nothing is allocated. `state` is
+ * the string's once-flag: 0 = untouched, 1 = being decrypted, 2 = ready.
+ * Only the thread that wins 0 -> 1 writes dst; others wait for 2. */
+static char *obf_decrypt_into_with(int *state, char *dst, char *enc_ptr, int len, int key, int cipher) {
+    if (obf_load_acquire_int(state) == 2) return dst;
+    if (obf_cas_int(state, 0, 1)) {
+        if (len > 0 && enc_ptr) obf_decode(dst, enc_ptr, (size_t)len, (uint32_t)key, cipher);
+        dst[len > 0 ? len : 0] = '\0';
+        obf_store_release_int(state, 2);
+        return dst;
     }
-    obf_mutex_unlock(&obf_mutex);
+    while (obf_load_acquire_int(state) != 2)
+        obf_cpu_relax();
+    return dst;
+}
+
+/* ---- Per-activation arenas ---------------------------------------------
+ * StringObfPass in "arena" mode brackets each function with
+ *   mark = __obf_arena_begin(); ... __obf_arena_decrypt*() ... __obf_arena_end(mark)
+ * Decrypted strings are bump-allocated from a thread-local stack of chunks;
+ * __obf_arena_end zeroes everything allocated since `mark` and pops back to
+ * it. A mark only has to be below the current top, so an activation that
+ * unwound without releasing is reclaimed by the next caller that does. One
+ * empty chunk is kept per thread so call/return does not hit malloc. */
+#define OBF_ARENA_CHUNK 4096
+#define OBF_ARENA_ALIGN 8
+
+struct obf_chunk {
+    struct obf_chunk *prev;
+    size_t cap, used;
+    char data[];
+};
+
+static OBF_TLS struct obf_chunk *obf_arena_top;
+static OBF_TLS struct obf_chunk *obf_arena_spare;
+static obf_tls_key_t obf_arena_key;
+
+static int obf_chunk_holds(const struct obf_chunk *c, const char *p) {
+    uintptr_t lo = (uintptr_t)c->data, v = (uintptr_t)p;
+    return v >= lo && v <= lo + c->used;
+}
+
+static void obf_chunk_release(struct obf_chunk *c) {
+    if (!obf_arena_spare && c->cap == OBF_ARENA_CHUNK) {
+        c->used = 0;
+        obf_arena_spare = c;
+    } else {
+        free(c);
+    }
+}
+
+static char *obf_arena_alloc(size_t n) {
+    size_t need = (n + OBF_ARENA_ALIGN - 1) & ~(size_t)(OBF_ARENA_ALIGN - 1);
+    struct obf_chunk *c = obf_arena_top;
+    if (!c || c->cap - c->used < need) {
+        if (need <= OBF_ARENA_CHUNK && obf_arena_spare) {
+            c = obf_arena_spare;
+            obf_arena_spare = NULL;
+        } else {
+            size_t cap = need > OBF_ARENA_CHUNK ? need : OBF_ARENA_CHUNK;
+            c = (struct obf_chunk*)malloc(sizeof(struct obf_chunk) + cap);
+            if (!c) return NULL;
+            c->cap = cap;
+            obf_tls_key_arm(obf_arena_key);
+        }
+        c->used = 0;
+        c->prev = obf_arena_top;
+        obf_arena_top = c;
+    }
+    char *p = c->data + c->used;
+    c->used += need;
+    return p;
+}
+
+/* pthread key / FLS destructor: the thread is gone, drop all its chunks */
+static void obf_arena_thread_exit(void *unused) {
+    (void)unused;
+    while (obf_arena_top) {
+        struct obf_chunk *prev = obf_arena_top->prev;
+        obf_secure_zero(obf_arena_top->data, obf_arena_top->used);
+        free(obf_arena_top);
+        obf_arena_top = prev;
+    }
+    free(obf_arena_spare);
+    obf_arena_spare = NULL;
+}
+
+static char *obf_decrypt_arena_with(char *enc_ptr, int len, int key, int cipher) {
+    if (len <= 0 || !enc_ptr) return NULL;
+    char *buf = obf_arena_alloc((size_t)len + 1);
+    if (!buf) return NULL;
+    obf_decode(buf, enc_ptr, (size_t)len, (uint32_t)key, cipher);
     buf[len] = '\0';
     return buf;
 }
 
+NOINLINE char *__obf_arena_begin(void) {
+    struct obf_chunk *c = obf_arena_top;
+    return c ? c->data + c->used : NULL;
+}
+
+NOINLINE void __obf_arena_end(char *mark) {
+    while (obf_arena_top && !(mark && obf_chunk_holds(obf_arena_top, mark))) {
+        struct obf_chunk *c = obf_arena_top;
+        obf_arena_top = c->prev;
+        obf_secure_zero(c->data, c->used);
+        obf_chunk_release(c);
+    }
+    if (obf_arena_top) {
+        size_t off = (size_t)(mark - obf_arena_top->data);
+        obf_secure_zero(mark, obf_arena_top->used - off);
+        obf_arena_top->used = off;
+    }
+}
+
+NOINLINE char *__obf_decrypt_arena(char *enc_ptr, int len, int key) {
+    return obf_decrypt_arena_with(enc_ptr, len, key, OBF_CIPHER_BYTE);
+}
+
+NOINLINE char *__obf_decrypt_arena_ks(char *enc_ptr, int len, int key) {
+    return obf_decrypt_arena_with(enc_ptr, len, key, OBF_CIPHER_STREAM);
+}
+
+NOINLINE char *__obf_decrypt(char *enc_ptr, int len, int key) {
+    return obf_decrypt_with(enc_ptr, len, key, OBF_CIPHER_BYTE);
+}
+
+NOINLINE char *__obf_decrypt_ks(char *enc_ptr, int len, int key) {
+    return obf_decrypt_with(enc_ptr, len, key, OBF_CIPHER_STREAM);
+}
+
+NOINLINE char *__obf_decrypt_once(char **slot, char *enc_ptr, int len, int key) {
+    return obf_decrypt_once_with(slot, enc_ptr, len, key, OBF_CIPHER_BYTE);
+}
+
+NOINLINE char *__obf_decrypt_once_ks(char **slot, char *enc_ptr, int len, int key) {
+    return obf_decrypt_once_with(slot, enc_ptr, len, key, OBF_CIPHER_STREAM);
+}
+
+NOINLINE char *__obf_decrypt_into(int *state, char *dst, char *enc_ptr, int len, int key) {
+    return obf_decrypt_into_with(state, dst, enc_ptr, len, key, OBF_CIPHER_BYTE);
+}
+
+NOINLINE char *__obf_decrypt_into_ks(int *state, char *dst, char *enc_ptr, int len, int key) {
+    return obf_decrypt_into_with(state, dst, enc_ptr, len, key, OBF_CIPHER_STREAM);
+}
+
 NOINLINE void __obf_free(char *ptr, int len) {
     if (!ptr) return;
-    secure_zero(ptr, (size_t)len);
+    obf_secure_zero(ptr, (size_t)len);
     free(ptr);
 }
 
@@ -55,12 +383,12 @@ NOINLINE int __obf_opaque(int x) {
     return s & 0xFF;
 }
 
-/* initializer to set up mutex automatically */
+/* initializer to set up mutex, arena cleanup and pick the decrypt kernel */
 __attribute__((constructor))
 static void __obf_runtime_init(void) {
-#ifdef _WIN32
-    obf_mutex_init(&obf_mutex);
-#else
+#ifdef OBF_RUNTIME_SERIALIZED
     obf_mutex_init(&obf_mutex);
 #endif
+    obf_tls_key_create(&obf_arena_key, obf_arena_thread_exit);
+    obf_stream_kernel = obf_select_stream_kernel();
 }
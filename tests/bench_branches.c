@@ -0,0 +1,40 @@
+// Runtime-overhead kernel: branch heavy. Classifies a pseudo-random stream
+// through nested conditionals and a switch, the shape bogus control flow and
+// flattening multiply.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int classify(unsigned x) {
+    if (x % 3 == 0) {
+        if (x & 1) return 1;
+        return 2;
+    } else if (x % 5 == 0) {
+        return 3;
+    } else if ((x >> 4) & 1) {
+        return 4;
+    }
+    return 0;
+}
+
+unsigned long branch_kernel(int n) {
+    unsigned seed = 1;
+    unsigned long acc = 0;
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        switch (classify(seed >> 8)) {
+        case 1: acc += seed & 0xff; break;
+        case 2: acc ^= seed; break;
+        case 3: acc = acc * 3 + 1; break;
+        case 4: acc -= i; break;
+        default: acc += 7; break;
+        }
+    }
+    return acc;
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 10000000;
+    printf("branches %lu\n", branch_kernel(n));
+    return 0;
+}
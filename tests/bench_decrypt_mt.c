@@ -0,0 +1,117 @@
+// Multi-threaded stress benchmark for the string decryption runtime.
+// Spawns 1, 2, 4, ... up to N threads that each decrypt and free the same
+// encrypted literal in a tight loop, and reports aggregate throughput plus
+// scaling efficiency relative to the single-threaded run. With "arena" the
+// workers use the per-activation arena API instead of decrypt + free.
+//
+// Usage: bench_decrypt_mt [iterations_per_thread] [max_threads] [heap|arena]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+char *__obf_decrypt(char *enc_ptr, int len, int key);
+void __obf_free(char *ptr, int len);
+char *__obf_arena_begin(void);
+void __obf_arena_end(char *mark);
+char *__obf_decrypt_arena(char *enc_ptr, int len, int key);
+
+#define STR_LEN 64
+#define KEY 0x5Au
+
+static char enc_str[STR_LEN];
+static long iterations = 200000;
+static int use_arena = 0;
+
+struct worker {
+    pthread_t tid;
+    unsigned long checksum;
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = (struct worker *)arg;
+    unsigned long sum = 0;
+    for (long i = 0; i < iterations && use_arena; ++i) {
+        char *mark = __obf_arena_begin();
+        char *p = __obf_decrypt_arena(enc_str, STR_LEN, (int)KEY);
+        char *q = __obf_decrypt_arena(enc_str, STR_LEN, (int)KEY);
+        if (!p || !q) break;
+        sum += (unsigned char)p[i % STR_LEN] + (unsigned char)q[(i + 1) % STR_LEN];
+        __obf_arena_end(mark);
+    }
+    for (long i = 0; i < iterations && !use_arena; ++i) {
+        char *p = __obf_decrypt(enc_str, STR_LEN, (int)KEY);
+        if (!p) break;
+        sum += (unsigned char)p[i % STR_LEN];
+        __obf_free(p, STR_LEN);
+    }
+    w->checksum = sum;
+    return NULL;
+}
+
+static double run(int nthreads) {
+    struct worker *ws = calloc((size_t)nthreads, sizeof(*ws));
+    if (!ws) return 0.0;
+    double t0 = now_sec();
+    for (int i = 0; i < nthreads; ++i)
+        pthread_create(&ws[i].tid, NULL, worker_main, &ws[i]);
+    for (int i = 0; i < nthreads; ++i)
+        pthread_join(ws[i].tid, NULL);
+    double elapsed = now_sec() - t0;
+    free(ws);
+    return (double)iterations * nthreads / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = ncpu > 0 ? (int)ncpu : 1;
+    if (argc > 1) iterations = atol(argv[1]);
+    if (argc > 2) max_threads = atoi(argv[2]);
+    if (argc > 3) use_arena = strcmp(argv[3], "arena") == 0;
+    if (iterations <= 0 || max_threads <= 0) {
+        fprintf(stderr, "usage: %s [iterations_per_thread] [max_threads] [heap|arena]\n", argv[0]);
+        return 1;
+    }
+
+    const char *plain = "The quick brown fox jumps over the lazy dog, 0123456789 ABCDEF!";
+    for (int i = 0; i < STR_LEN; ++i)
+        enc_str[i] = (char)((unsigned char)plain[i] ^ KEY);
+
+    char *check = __obf_decrypt(enc_str, STR_LEN, (int)KEY);
+    if (!check || memcmp(check, plain, STR_LEN) != 0) {
+        fprintf(stderr, "decryption mismatch\n");
+        return 1;
+    }
+    __obf_free(check, STR_LEN);
+
+    char *mark = __obf_arena_begin();
+    check = __obf_decrypt_arena(enc_str, STR_LEN, (int)KEY);
+    if (!check || memcmp(check, plain, STR_LEN) != 0) {
+        fprintf(stderr, "arena decryption mismatch\n");
+        return 1;
+    }
+    __obf_arena_end(mark);
+    if (check[0] != 0) {
+        fprintf(stderr, "arena not zeroed on release\n");
+        return 1;
+    }
+
+    printf("%-8s %16s %12s\n", "threads", "decrypts/sec", "efficiency");
+    double base = 0.0;
+    for (int n = 1; n <= max_threads; n = (n * 2 > max_threads && n != max_threads) ? max_threads : n * 2) {
+        double rate = run(n);
+        if (n == 1) base = rate;
+        double eff = base > 0.0 ? rate / (base * n) * 100.0 : 0.0;
+        printf("%-8d %16.0f %11.1f%%\n", n, rate, eff);
+    }
+    return 0;
+}
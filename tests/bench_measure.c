@@ -0,0 +1,69 @@
+// Runs a command several times and reports its wall time and peak RSS, for
+// scripts/bench_runtime.sh. The command's stdout goes to /dev/null; any
+// failing run fails the measurement.
+//
+// Prints one line: "<median_us> <min_us> <max_us> <peak_rss_kb>", where the
+// peak is the largest ru_maxrss of any run.
+//
+// Usage: bench_measure <runs> <command> [args...]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || atoi(argv[1]) < 1) {
+        fprintf(stderr, "usage: bench_measure <runs> <command> [args...]\n");
+        return 2;
+    }
+    int runs = atoi(argv[1]);
+    long *times = malloc(sizeof(long) * runs);
+    long peak_kb = 0;
+    for (int r = 0; r < runs; r++) {
+        long start = now_us();
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("bench_measure: fork");
+            return 1;
+        }
+        if (pid == 0) {
+            int null = open("/dev/null", O_WRONLY);
+            if (null >= 0) dup2(null, STDOUT_FILENO);
+            execvp(argv[2], argv + 2);
+            perror("bench_measure: exec");
+            _exit(127);
+        }
+        int status;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) < 0) {
+            perror("bench_measure: wait4");
+            return 1;
+        }
+        times[r] = now_us() - start;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "bench_measure: %s failed on run %d\n", argv[2], r + 1);
+            return 1;
+        }
+        if (usage.ru_maxrss > peak_kb) peak_kb = usage.ru_maxrss;
+    }
+    qsort(times, runs, sizeof(long), cmp_long);
+    long median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    printf("%ld %ld %ld %ld\n", median, times[0], times[runs - 1], peak_kb);
+    free(times);
+    return 0;
+}
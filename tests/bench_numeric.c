@@ -0,0 +1,35 @@
+// Runtime-overhead kernel: loops and arithmetic. Repeated 64x64 integer
+// matrix multiplication, a tight loop nest with no strings and few branches.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 64
+
+static unsigned a[N][N], b[N][N], c[N][N];
+
+unsigned matmul_kernel(int reps) {
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++) {
+            a[i][j] = i * 31 + j;
+            b[i][j] = i ^ (j * 7);
+        }
+    unsigned sum = 0;
+    for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++) {
+                unsigned s = 0;
+                for (int k = 0; k < N; k++) s += a[i][k] * b[k][j];
+                c[i][j] = s;
+            }
+        sum += c[r & (N - 1)][(r * 5) & (N - 1)];
+        a[r & (N - 1)][0] += sum;
+    }
+    return sum;
+}
+
+int main(int argc, char **argv) {
+    int reps = argc > 1 ? atoi(argv[1]) : 1000;
+    printf("numeric %u\n", matmul_kernel(reps));
+    return 0;
+}
@@ -0,0 +1,16 @@
+// Runtime-overhead kernel: recursion. Naive Fibonacci, dominated by call
+// overhead and the short blocks around each call.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+unsigned long fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 36;
+    printf("recursion %lu\n", fib(n));
+    return 0;
+}
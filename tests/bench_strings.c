@@ -0,0 +1,28 @@
+// Runtime-overhead kernel: string heavy. Hashes, compares and measures a
+// table of string literals, so string obfuscation's decryption sits on the
+// hot path.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const words[8] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+};
+
+unsigned long string_kernel(int n) {
+    unsigned long h = 5381;
+    for (int i = 0; i < n; i++) {
+        const char *w = words[i & 7];
+        for (const char *p = w; *p; p++) h = h * 33 + (unsigned char)*p;
+        if (strcmp(w, "delta") == 0) h ^= (unsigned long)i;
+        h += strlen(w);
+    }
+    return h;
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 10000000;
+    printf("strings %lu\n", string_kernel(n));
+    return 0;
+}
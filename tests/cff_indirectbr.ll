@@ -0,0 +1,132 @@
+; Small bytecode interpreter with computed goto, for checking cff on
+; functions that keep an indirectbr. Several handlers are reached both
+; through the indirectbr and through ordinary branches, which cff routes via
+; its dispatcher. Written at -O0 style (state in allocas). Equivalent C:
+;
+;   static const unsigned char prog[] = {0, 1, 2, 0, 2, 1, 2, 0, 3};
+;   long run(long acc) {
+;     static void *ops[] = {&&add, &&dbl, &&dec, &&halt};
+;     int pc = 0;
+;   next:
+;     goto *ops[prog[pc++]];
+;   add:
+;     acc += 7;
+;     goto check;
+;   dbl:
+;     acc *= 2;
+;     goto check;
+;   dec:
+;     acc -= 3;
+;     if (acc & 1) goto odd;
+;     goto next;
+;   odd:
+;     acc += 1;
+;     goto add;
+;   check:
+;     if (acc > 100) acc -= 50;
+;     goto next;
+;   halt:
+;     return acc;
+;   }
+;   int main(void) {
+;     long sum = 0;
+;     for (long i = 0; i < 10; i++) sum += run(i);
+;     printf("%ld\n", sum);
+;   }
+
+@prog = private unnamed_addr constant [9 x i8] c"\00\01\02\00\02\01\02\00\03"
+@ops = private unnamed_addr constant [4 x i8*] [i8* blockaddress(@run, %add), i8* blockaddress(@run, %dbl), i8* blockaddress(@run, %dec), i8* blockaddress(@run, %halt)]
+@.fmt = private unnamed_addr constant [5 x i8] c"%ld\0A\00"
+
+define i64 @run(i64 %start) {
+entry:
+  %acc = alloca i64
+  %pc = alloca i32
+  store i64 %start, i64* %acc
+  store i32 0, i32* %pc
+  br label %next
+
+next:
+  %p = load i32, i32* %pc
+  %p1 = add i32 %p, 1
+  store i32 %p1, i32* %pc
+  %px = sext i32 %p to i64
+  %opp = getelementptr [9 x i8], [9 x i8]* @prog, i64 0, i64 %px
+  %op = load i8, i8* %opp
+  %opx = zext i8 %op to i64
+  %slot = getelementptr [4 x i8*], [4 x i8*]* @ops, i64 0, i64 %opx
+  %target = load i8*, i8** %slot
+  indirectbr i8* %target, [label %add, label %dbl, label %dec, label %halt]
+
+add:
+  %a0 = load i64, i64* %acc
+  %a1 = add i64 %a0, 7
+  store i64 %a1, i64* %acc
+  br label %check
+
+dbl:
+  %d0 = load i64, i64* %acc
+  %d1 = mul i64 %d0, 2
+  store i64 %d1, i64* %acc
+  br label %check
+
+dec:
+  %e0 = load i64, i64* %acc
+  %e1 = sub i64 %e0, 3
+  store i64 %e1, i64* %acc
+  %bit = and i64 %e1, 1
+  %isodd = icmp ne i64 %bit, 0
+  br i1 %isodd, label %odd, label %next
+
+odd:
+  %o0 = load i64, i64* %acc
+  %o1 = add i64 %o0, 1
+  store i64 %o1, i64* %acc
+  br label %add
+
+check:
+  %c0 = load i64, i64* %acc
+  %big = icmp sgt i64 %c0, 100
+  br i1 %big, label %clamp, label %next
+
+clamp:
+  %k0 = load i64, i64* %acc
+  %k1 = sub i64 %k0, 50
+  store i64 %k1, i64* %acc
+  br label %next
+
+halt:
+  %r = load i64, i64* %acc
+  ret i64 %r
+}
+
+define i32 @main() {
+entry:
+  %sum = alloca i64
+  %i = alloca i64
+  store i64 0, i64* %sum
+  store i64 0, i64* %i
+  br label %cond
+
+cond:
+  %iv = load i64, i64* %i
+  %more = icmp slt i64 %iv, 10
+  br i1 %more, label %body, label %done
+
+body:
+  %iv1 = load i64, i64* %i
+  %r = call i64 @run(i64 %iv1)
+  %s0 = load i64, i64* %sum
+  %s1 = add i64 %s0, %r
+  store i64 %s1, i64* %sum
+  %inc = add i64 %iv1, 1
+  store i64 %inc, i64* %i
+  br label %cond
+
+done:
+  %s = load i64, i64* %sum
+  %pr = call i32 (i8*, ...) @printf(i8* getelementptr ([5 x i8], [5 x i8]* @.fmt, i64 0, i64 0), i64 %s)
+  ret i32 0
+}
+
+declare i32 @printf(i8*, ...)
@@ -0,0 +1,242 @@
+; Loop-heavy kernels for benchmarking control flow flattening.
+; Written at -O0 style (locals in allocas, no cross-block SSA values) so every
+; CFF mode can flatten it as-is. Equivalent C:
+;
+;   long collatz_steps(int n) {            // total Collatz steps for 1..n
+;     long steps = 0;
+;     for (int i = 1; i <= n; i++) {
+;       long x = i;
+;       while (x != 1) { x = (x & 1) ? 3 * x + 1 : x / 2; steps++; }
+;     }
+;     return steps;
+;   }
+;   unsigned sort_checksum(int reps) {     // insertion sort of 512 LCG values
+;     unsigned a[512], seed = 1, sum = 0;
+;     for (int r = 0; r < reps; r++) {
+;       for (int i = 0; i < 512; i++) { seed = seed * 1103515245 + 12345; a[i] = seed >> 8; }
+;       for (int i = 1; i < 512; i++) {
+;         unsigned v = a[i]; int j = i - 1;
+;         while (j >= 0 && a[j] > v) { a[j + 1] = a[j]; j--; }
+;         a[j + 1] = v;
+;       }
+;       sum += a[r & 511];
+;     }
+;     return sum;
+;   }
+;   int main(int argc, char **argv) {
+;     int n = argc > 1 ? atoi(argv[1]) : 300000;
+;     printf("collatz %ld\nsort %u\n", collatz_steps(n), sort_checksum(n / 1000));
+;   }
+
+@.fmt = private unnamed_addr constant [21 x i8] c"collatz %ld\0Asort %u\0A\00", align 1
+
+declare i32 @printf(i8*, ...)
+declare i32 @atoi(i8*)
+
+define i64 @collatz_steps(i32 %n) {
+entry:
+  %n.addr = alloca i32, align 4
+  %steps = alloca i64, align 8
+  %i = alloca i32, align 4
+  %x = alloca i64, align 8
+  store i32 %n, i32* %n.addr, align 4
+  store i64 0, i64* %steps, align 8
+  store i32 1, i32* %i, align 4
+  br label %for.cond
+
+for.cond:
+  %0 = load i32, i32* %i, align 4
+  %1 = load i32, i32* %n.addr, align 4
+  %cmp = icmp sle i32 %0, %1
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %2 = load i32, i32* %i, align 4
+  %conv = sext i32 %2 to i64
+  store i64 %conv, i64* %x, align 8
+  br label %while.cond
+
+while.cond:
+  %3 = load i64, i64* %x, align 8
+  %cmp1 = icmp ne i64 %3, 1
+  br i1 %cmp1, label %while.body, label %for.inc
+
+while.body:
+  %4 = load i64, i64* %x, align 8
+  %and = and i64 %4, 1
+  %tobool = icmp ne i64 %and, 0
+  br i1 %tobool, label %odd, label %even
+
+odd:
+  %5 = load i64, i64* %x, align 8
+  %mul = mul nsw i64 3, %5
+  %add = add nsw i64 %mul, 1
+  store i64 %add, i64* %x, align 8
+  br label %step
+
+even:
+  %6 = load i64, i64* %x, align 8
+  %div = sdiv i64 %6, 2
+  store i64 %div, i64* %x, align 8
+  br label %step
+
+step:
+  %7 = load i64, i64* %steps, align 8
+  %inc = add nsw i64 %7, 1
+  store i64 %inc, i64* %steps, align 8
+  br label %while.cond
+
+for.inc:
+  %8 = load i32, i32* %i, align 4
+  %inc2 = add nsw i32 %8, 1
+  store i32 %inc2, i32* %i, align 4
+  br label %for.cond
+
+for.end:
+  %9 = load i64, i64* %steps, align 8
+  ret i64 %9
+}
+
+define i32 @sort_checksum(i32 %reps) {
+entry:
+  %reps.addr = alloca i32, align 4
+  %a = alloca [512 x i32], align 16
+  %seed = alloca i32, align 4
+  %sum = alloca i32, align 4
+  %r = alloca i32, align 4
+  %i = alloca i32, align 4
+  %v = alloca i32, align 4
+  %j = alloca i32, align 4
+  store i32 %reps, i32* %reps.addr, align 4
+  store i32 1, i32* %seed, align 4
+  store i32 0, i32* %sum, align 4
+  store i32 0, i32* %r, align 4
+  br label %rep.cond
+
+rep.cond:
+  %0 = load i32, i32* %r, align 4
+  %1 = load i32, i32* %reps.addr, align 4
+  %cmp = icmp slt i32 %0, %1
+  br i1 %cmp, label %fill.init, label %rep.end
+
+fill.init:
+  store i32 0, i32* %i, align 4
+  br label %fill.cond
+
+fill.cond:
+  %2 = load i32, i32* %i, align 4
+  %cmp1 = icmp slt i32 %2, 512
+  br i1 %cmp1, label %fill.body, label %sort.init
+
+fill.body:
+  %3 = load i32, i32* %seed, align 4
+  %mul = mul i32 %3, 1103515245
+  %add = add i32 %mul, 12345
+  store i32 %add, i32* %seed, align 4
+  %shr = lshr i32 %add, 8
+  %4 = load i32, i32* %i, align 4
+  %idx = sext i32 %4 to i64
+  %p = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx
+  store i32 %shr, i32* %p, align 4
+  %inc = add nsw i32 %4, 1
+  store i32 %inc, i32* %i, align 4
+  br label %fill.cond
+
+sort.init:
+  store i32 1, i32* %i, align 4
+  br label %sort.cond
+
+sort.cond:
+  %5 = load i32, i32* %i, align 4
+  %cmp2 = icmp slt i32 %5, 512
+  br i1 %cmp2, label %sort.body, label %rep.inc
+
+sort.body:
+  %6 = load i32, i32* %i, align 4
+  %idx2 = sext i32 %6 to i64
+  %p2 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx2
+  %7 = load i32, i32* %p2, align 4
+  store i32 %7, i32* %v, align 4
+  %sub = sub nsw i32 %6, 1
+  store i32 %sub, i32* %j, align 4
+  br label %shift.cond
+
+shift.cond:
+  %8 = load i32, i32* %j, align 4
+  %cmp3 = icmp sge i32 %8, 0
+  br i1 %cmp3, label %shift.cmp, label %shift.end
+
+shift.cmp:
+  %9 = load i32, i32* %j, align 4
+  %idx3 = sext i32 %9 to i64
+  %p3 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx3
+  %10 = load i32, i32* %p3, align 4
+  %11 = load i32, i32* %v, align 4
+  %cmp4 = icmp ugt i32 %10, %11
+  br i1 %cmp4, label %shift.body, label %shift.end
+
+shift.body:
+  %12 = load i32, i32* %j, align 4
+  %idx4 = sext i32 %12 to i64
+  %p4 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx4
+  %13 = load i32, i32* %p4, align 4
+  %add5 = add nsw i32 %12, 1
+  %idx5 = sext i32 %add5 to i64
+  %p5 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx5
+  store i32 %13, i32* %p5, align 4
+  %dec = sub nsw i32 %12, 1
+  store i32 %dec, i32* %j, align 4
+  br label %shift.cond
+
+shift.end:
+  %14 = load i32, i32* %v, align 4
+  %15 = load i32, i32* %j, align 4
+  %add6 = add nsw i32 %15, 1
+  %idx6 = sext i32 %add6 to i64
+  %p6 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx6
+  store i32 %14, i32* %p6, align 4
+  %16 = load i32, i32* %i, align 4
+  %inc7 = add nsw i32 %16, 1
+  store i32 %inc7, i32* %i, align 4
+  br label %sort.cond
+
+rep.inc:
+  %17 = load i32, i32* %r, align 4
+  %and = and i32 %17, 511
+  %idx8 = sext i32 %and to i64
+  %p8 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx8
+  %18 = load i32, i32* %p8, align 4
+  %19 = load i32, i32* %sum, align 4
+  %add9 = add i32 %19, %18
+  store i32 %add9, i32* %sum, align 4
+  %inc10 = add nsw i32 %17, 1
+  store i32 %inc10, i32* %r, align 4
+  br label %rep.cond
+
+rep.end:
+  %20 = load i32, i32* %sum, align 4
+  ret i32 %20
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %n = alloca i32, align 4
+  store i32 300000, i32* %n, align 4
+  %cmp = icmp sgt i32 %argc, 1
+  br i1 %cmp, label %parse, label %run
+
+parse:
+  %arrayidx = getelementptr inbounds i8*, i8** %argv, i64 1
+  %0 = load i8*, i8** %arrayidx, align 8
+  %call = call i32 @atoi(i8* %0)
+  store i32 %call, i32* %n, align 4
+  br label %run
+
+run:
+  %1 = load i32, i32* %n, align 4
+  %steps = call i64 @collatz_steps(i32 %1)
+  %reps = sdiv i32 %1, 1000
+  %sum = call i32 @sort_checksum(i32 %reps)
+  %call1 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([21 x i8], [21 x i8]* @.fmt, i64 0, i64 0), i64 %steps, i32 %sum)
+  ret i32 0
+}
@@ -0,0 +1,262 @@
+; tests/cff_kernels.ll with the profile of `cff_kernels 100000` applied by
+; `opt -passes=pgo-instr-use` (function entry counts, branch weights and the
+; ProfileSummary module flag). Used to check profile-guided obfuscation.
+
+@.fmt = private unnamed_addr constant [21 x i8] c"collatz %ld\0Asort %u\0A\00", align 1
+
+declare i32 @printf(i8*, ...)
+
+declare i32 @atoi(i8*)
+
+define i64 @collatz_steps(i32 %n) !prof !29 {
+entry:
+  %n.addr = alloca i32, align 4
+  %steps = alloca i64, align 8
+  %i = alloca i32, align 4
+  %x = alloca i64, align 8
+  store i32 %n, i32* %n.addr, align 4
+  store i64 0, i64* %steps, align 8
+  store i32 1, i32* %i, align 4
+  br label %for.cond
+
+for.cond:                                         ; preds = %for.inc, %entry
+  %0 = load i32, i32* %i, align 4
+  %1 = load i32, i32* %n.addr, align 4
+  %cmp = icmp sle i32 %0, %1
+  br i1 %cmp, label %for.body, label %for.end, !prof !30
+
+for.body:                                         ; preds = %for.cond
+  %2 = load i32, i32* %i, align 4
+  %conv = sext i32 %2 to i64
+  store i64 %conv, i64* %x, align 8
+  br label %while.cond
+
+while.cond:                                       ; preds = %step, %for.body
+  %3 = load i64, i64* %x, align 8
+  %cmp1 = icmp ne i64 %3, 1
+  br i1 %cmp1, label %while.body, label %for.inc, !prof !31
+
+while.body:                                       ; preds = %while.cond
+  %4 = load i64, i64* %x, align 8
+  %and = and i64 %4, 1
+  %tobool = icmp ne i64 %and, 0
+  br i1 %tobool, label %odd, label %even, !prof !32
+
+odd:                                              ; preds = %while.body
+  %5 = load i64, i64* %x, align 8
+  %mul = mul nsw i64 3, %5
+  %add = add nsw i64 %mul, 1
+  store i64 %add, i64* %x, align 8
+  br label %step
+
+even:                                             ; preds = %while.body
+  %6 = load i64, i64* %x, align 8
+  %div = sdiv i64 %6, 2
+  store i64 %div, i64* %x, align 8
+  br label %step
+
+step:                                             ; preds = %even, %odd
+  %7 = load i64, i64* %steps, align 8
+  %inc = add nsw i64 %7, 1
+  store i64 %inc, i64* %steps, align 8
+  br label %while.cond
+
+for.inc:                                          ; preds = %while.cond
+  %8 = load i32, i32* %i, align 4
+  %inc2 = add nsw i32 %8, 1
+  store i32 %inc2, i32* %i, align 4
+  br label %for.cond
+
+for.end:                                          ; preds = %for.cond
+  %9 = load i64, i64* %steps, align 8
+  ret i64 %9
+}
+
+define i32 @sort_checksum(i32 %reps) !prof !29 {
+entry:
+  %reps.addr = alloca i32, align 4
+  %a = alloca [512 x i32], align 16
+  %seed = alloca i32, align 4
+  %sum = alloca i32, align 4
+  %r = alloca i32, align 4
+  %i = alloca i32, align 4
+  %v = alloca i32, align 4
+  %j = alloca i32, align 4
+  store i32 %reps, i32* %reps.addr, align 4
+  store i32 1, i32* %seed, align 4
+  store i32 0, i32* %sum, align 4
+  store i32 0, i32* %r, align 4
+  br label %rep.cond
+
+rep.cond:                                         ; preds = %rep.inc, %entry
+  %0 = load i32, i32* %r, align 4
+  %1 = load i32, i32* %reps.addr, align 4
+  %cmp = icmp slt i32 %0, %1
+  br i1 %cmp, label %fill.init, label %rep.end, !prof !33
+
+fill.init:                                        ; preds = %rep.cond
+  store i32 0, i32* %i, align 4
+  br label %fill.cond
+
+fill.cond:                                        ; preds = %fill.body, %fill.init
+  %2 = load i32, i32* %i, align 4
+  %cmp1 = icmp slt i32 %2, 512
+  br i1 %cmp1, label %fill.body, label %sort.init, !prof !34
+
+fill.body:                                        ; preds = %fill.cond
+  %3 = load i32, i32* %seed, align 4
+  %mul = mul i32 %3, 1103515245
+  %add = add i32 %mul, 12345
+  store i32 %add, i32* %seed, align 4
+  %shr = lshr i32 %add, 8
+  %4 = load i32, i32* %i, align 4
+  %idx = sext i32 %4 to i64
+  %p = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx
+  store i32 %shr, i32* %p, align 4
+  %inc = add nsw i32 %4, 1
+  store i32 %inc, i32* %i, align 4
+  br label %fill.cond
+
+sort.init:                                        ; preds = %fill.cond
+  store i32 1, i32* %i, align 4
+  br label %sort.cond
+
+sort.cond:                                        ; preds = %shift.end, %sort.init
+  %5 = load i32, i32* %i, align 4
+  %cmp2 = icmp slt i32 %5, 512
+  br i1 %cmp2, label %sort.body, label %rep.inc, !prof !35
+
+sort.body:                                        ; preds = %sort.cond
+  %6 = load i32, i32* %i, align 4
+  %idx2 = sext i32 %6 to i64
+  %p2 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx2
+  %7 = load i32, i32* %p2, align 4
+  store i32 %7, i32* %v, align 4
+  %sub = sub nsw i32 %6, 1
+  store i32 %sub, i32* %j, align 4
+  br label %shift.cond
+
+shift.cond:                                       ; preds = %shift.body, %sort.body
+  %8 = load i32, i32* %j, align 4
+  %cmp3 = icmp sge i32 %8, 0
+  br i1 %cmp3, label %shift.cmp, label %shift.end, !prof !36
+
+shift.cmp:                                        ; preds = %shift.cond
+  %9 = load i32, i32* %j, align 4
+  %idx3 = sext i32 %9 to i64
+  %p3 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx3
+  %10 = load i32, i32* %p3, align 4
+  %11 = load i32, i32* %v, align 4
+  %cmp4 = icmp ugt i32 %10, %11
+  br i1 %cmp4, label %shift.body, label %shift.end, !prof !37
+
+shift.body:                                       ; preds = %shift.cmp
+  %12 = load i32, i32* %j, align 4
+  %idx4 = sext i32 %12 to i64
+  %p4 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx4
+  %13 = load i32, i32* %p4, align 4
+  %add5 = add nsw i32 %12, 1
+  %idx5 = sext i32 %add5 to i64
+  %p5 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx5
+  store i32 %13, i32* %p5, align 4
+  %dec = sub nsw i32 %12, 1
+  store i32 %dec, i32* %j, align 4
+  br label %shift.cond
+
+shift.end:                                        ; preds = %shift.cmp, %shift.cond
+  %14 = load i32, i32* %v, align 4
+  %15 = load i32, i32* %j, align 4
+  %add6 = add nsw i32 %15, 1
+  %idx6 = sext i32 %add6 to i64
+  %p6 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx6
+  store i32 %14, i32* %p6, align 4
+  %16 = load i32, i32* %i, align 4
+  %inc7 = add nsw i32 %16, 1
+  store i32 %inc7, i32* %i, align 4
+  br label %sort.cond
+
+rep.inc:                                          ; preds = %sort.cond
+  %17 = load i32, i32* %r, align 4
+  %and = and i32 %17, 511
+  %idx8 = sext i32 %and to i64
+  %p8 = getelementptr inbounds [512 x i32], [512 x i32]* %a, i64 0, i64 %idx8
+  %18 = load i32, i32* %p8, align 4
+  %19 = load i32, i32* %sum, align 4
+  %add9 = add i32 %19, %18
+  store i32 %add9, i32* %sum, align 4
+  %inc10 = add nsw i32 %17, 1
+  store i32 %inc10, i32* %r, align 4
+  br label %rep.cond
+
+rep.end:                                          ; preds = %rep.cond
+  %20 = load i32, i32* %sum, align 4
+  ret i32 %20
+}
+
+; Function Attrs: cold
+define i32 @main(i32 %argc, i8** %argv) #0 !prof !29 {
+entry:
+  %n = alloca i32, align 4
+  store i32 300000, i32* %n, align 4
+  %cmp = icmp sgt i32 %argc, 1
+  br i1 %cmp, label %parse, label %run, !prof !38
+
+parse:                                            ; preds = %entry
+  %arrayidx = getelementptr inbounds i8*, i8** %argv, i64 1
+  %0 = load i8*, i8** %arrayidx, align 8
+  %call = call i32 @atoi(i8* %0)
+  store i32 %call, i32* %n, align 4
+  br label %run
+
+run:                                              ; preds = %parse, %entry
+  %1 = load i32, i32* %n, align 4
+  %steps = call i64 @collatz_steps(i32 %1)
+  %reps = sdiv i32 %1, 1000
+  %sum = call i32 @sort_checksum(i32 %reps)
+  %call1 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([21 x i8], [21 x i8]* @.fmt, i64 0, i64 0), i64 %steps, i32 %sum)
+  ret i32 0
+}
+
+attributes #0 = { cold }
+
+!llvm.module.flags = !{!0}
+
+!0 = !{i32 1, !"ProfileSummary", !1}
+!1 = !{!2, !3, !4, !5, !6, !7, !8, !9, !10, !11}
+!2 = !{!"ProfileFormat", !"InstrProf"}
+!3 = !{!"TotalCount", i64 24042860}
+!4 = !{!"MaxCount", i64 7188948}
+!5 = !{!"MaxInternalCount", i64 7188948}
+!6 = !{!"MaxFunctionCount", i64 6568551}
+!7 = !{!"NumCounts", i64 12}
+!8 = !{!"NumFunctions", i64 3}
+!9 = !{!"IsPartialProfile", i64 0}
+!10 = !{!"PartialProfileRatio", double 0.000000e+00}
+!11 = !{!"DetailedSummary", !12}
+!12 = !{!13, !14, !15, !16, !17, !18, !19, !20, !21, !22, !23, !24, !25, !26, !27, !28}
+!13 = !{i32 10000, i64 7188948, i32 1}
+!14 = !{i32 100000, i64 7188948, i32 1}
+!15 = !{i32 200000, i64 7188948, i32 1}
+!16 = !{i32 300000, i64 6568551, i32 2}
+!17 = !{i32 400000, i64 6568551, i32 2}
+!18 = !{i32 500000, i64 6568551, i32 2}
+!19 = !{i32 600000, i64 6518065, i32 3}
+!20 = !{i32 700000, i64 6518065, i32 3}
+!21 = !{i32 800000, i64 6518065, i32 3}
+!22 = !{i32 900000, i64 3564892, i32 4}
+!23 = !{i32 950000, i64 3564892, i32 4}
+!24 = !{i32 990000, i64 3564892, i32 4}
+!25 = !{i32 999000, i64 51100, i32 7}
+!26 = !{i32 999900, i64 51100, i32 7}
+!27 = !{i32 999990, i64 51100, i32 7}
+!28 = !{i32 999999, i64 100, i32 8}
+!29 = !{!"function_entry_count", i64 1}
+!30 = !{!"branch_weights", i32 100000, i32 1}
+!31 = !{!"branch_weights", i32 10753840, i32 100000}
+!32 = !{!"branch_weights", i32 3564892, i32 7188948}
+!33 = !{!"branch_weights", i32 100, i32 1}
+!34 = !{!"branch_weights", i32 51200, i32 100}
+!35 = !{!"branch_weights", i32 51100, i32 100}
+!36 = !{!"branch_weights", i32 6568551, i32 614}
+!37 = !{!"branch_weights", i32 6518065, i32 50486}
+!38 = !{!"branch_weights", i32 1, i32 0}
@@ -0,0 +1,24 @@
+; Strings of every length class the runtime decodes differently: under one
+; keystream word, a few words with a tail, and long enough for several
+; 16- and 32-byte SIMD blocks plus a tail. Equivalent C:
+;
+;   int main(void) {
+;     puts("ok");
+;     puts("keystream words");
+;     puts("The quick brown fox jumps over the lazy dog, then naps in the sun.");
+;     return 0;
+;   }
+
+@.str.short = private unnamed_addr constant [3 x i8] c"ok\00"
+@.str.words = private unnamed_addr constant [16 x i8] c"keystream words\00"
+@.str.long = private unnamed_addr constant [67 x i8] c"The quick brown fox jumps over the lazy dog, then naps in the sun.\00"
+
+define i32 @main() {
+entry:
+  %a = call i32 @puts(i8* getelementptr ([3 x i8], [3 x i8]* @.str.short, i64 0, i64 0))
+  %b = call i32 @puts(i8* getelementptr ([16 x i8], [16 x i8]* @.str.words, i64 0, i64 0))
+  %c = call i32 @puts(i8* getelementptr ([67 x i8], [67 x i8]* @.str.long, i64 0, i64 0))
+  ret i32 0
+}
+
+declare i32 @puts(i8*)
@@ -0,0 +1,493 @@
+// tools/obf_batch.cpp - batch mode of LLVM_OBFSCALTION.exe: compile, obfuscate
+// and codegen every entry of a compile_commands.json on a work-stealing pool.
+#include "obf_batch.h"
+#include "obf_cache.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Fixed pool of workers, each owning a deque. A worker pushes the tasks it
+// spawns (the next stage of its TU) onto the back of its own deque and pops
+// from the back, so a TU tends to finish on the thread that holds its module.
+// Idle workers steal the oldest task from the front of another deque.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned threads) {
+        for (unsigned i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    }
+
+    // From a worker: onto its own deque. Otherwise round robin.
+    void submit(Task task) {
+        pending.fetch_add(1);
+        unsigned target = current >= 0 ? unsigned(current) : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->m);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Runs the workers until every task, including those submitted by other
+    // tasks, has finished.
+    void run() {
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < queues.size(); ++i)
+            workers.emplace_back([this, i] { workerLoop(i); });
+        for (auto& worker : workers) worker.join();
+    }
+
+    unsigned steals() const { return stealCount.load(); }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    bool popLocal(unsigned self, Task& task) {
+        std::lock_guard<std::mutex> lock(queues[self]->m);
+        if (queues[self]->tasks.empty()) return false;
+        task = std::move(queues[self]->tasks.back());
+        queues[self]->tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned self, Task& task) {
+        for (unsigned k = 1; k < queues.size(); ++k) {
+            Queue& victim = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.m);
+            if (victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            stealCount++;
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned self) {
+        current = int(self);
+        Task task;
+        while (true) {
+            if (popLocal(self, task) || steal(self, task)) {
+                task();
+                task = nullptr;
+                if (pending.fetch_sub(1) == 1) wake.notify_all();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (pending.load() == 0) break;
+            // A short timeout covers a submit racing with going to sleep.
+            wake.wait_for(lock, std::chrono::milliseconds(2));
+        }
+        current = -1;
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<size_t> pending{0};
+    std::atomic<unsigned> nextQueue{0};
+    std::atomic<unsigned> stealCount{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    static thread_local int current;
+};
+
+thread_local int WorkStealingPool::current = -1;
+
+enum Stage { Compile, Obfuscate, Codegen, NumStages };
+const char* const StageNames[NumStages] = {"compile", "obfuscate", "codegen"};
+
+struct CompileEntry {
+    std::string directory;
+    std::string file;
+    std::vector<std::string> arguments;
+    std::string output;
+};
+
+// One TU travelling through the stages. The module stays in memory from
+// obfuscation to codegen, in its own context.
+struct Job {
+    unsigned index = 0;
+    CompileEntry entry;
+    fs::path scratch;
+    fs::path object;
+    std::string cacheKey;
+    std::unique_ptr<llvm::LLVMContext> context;
+    std::unique_ptr<llvm::Module> module;
+};
+
+// Splits a "command" string the way sh would for the common cases: blanks
+// separate arguments, quotes group them, backslash escapes one character.
+std::vector<std::string> splitCommand(const std::string& command) {
+    std::vector<std::string> args;
+    std::string current;
+    bool inArg = false;
+    char quote = 0;
+    for (size_t i = 0; i < command.size(); ++i) {
+        char c = command[i];
+        if (quote) {
+            if (c == quote) quote = 0;
+            else if (c == '\\' && quote == '"' && i + 1 < command.size()) current += command[++i];
+            else current += c;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            inArg = true;
+        } else if (c == '\\' && i + 1 < command.size()) {
+            current += command[++i];
+            inArg = true;
+        } else if (c == ' ' || c == '\t' || c == '\n') {
+            if (inArg) args.push_back(current);
+            current.clear();
+            inArg = false;
+        } else {
+            current += c;
+            inArg = true;
+        }
+    }
+    if (inArg) args.push_back(current);
+    return args;
+}
+
+std::string shellQuote(const std::string& arg) {
+    std::string quoted = "'";
+    for (char c : arg) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+bool readCompileCommands(const std::string& path, std::vector<CompileEntry>& entries, std::string& error) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        error = "cannot read " + path + ": " + buffer.getError().message();
+        return false;
+    }
+    llvm::Expected<llvm::json::Value> root = llvm::json::parse((*buffer)->getBuffer());
+    if (!root) {
+        error = path + ": " + llvm::toString(root.takeError());
+        return false;
+    }
+    const llvm::json::Array* array = root->getAsArray();
+    if (!array) {
+        error = path + ": expected an array of compile commands";
+        return false;
+    }
+    for (const llvm::json::Value& value : *array) {
+        const llvm::json::Object* object = value.getAsObject();
+        if (!object) continue;
+        CompileEntry entry;
+        if (auto directory = object->getString("directory")) entry.directory = directory->str();
+        if (auto file = object->getString("file")) entry.file = file->str();
+        if (auto output = object->getString("output")) entry.output = output->str();
+        if (const llvm::json::Array* arguments = object->getArray("arguments")) {
+            for (const llvm::json::Value& arg : *arguments)
+                if (auto s = arg.getAsString()) entry.arguments.push_back(s->str());
+        } else if (auto command = object->getString("command")) {
+            entry.arguments = splitCommand(command->str());
+        }
+        if (entry.file.empty()) {
+            error = path + ": entry without \"file\"";
+            return false;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+fs::path absoluteFile(const CompileEntry& entry) {
+    fs::path file(entry.file);
+    return file.is_absolute() ? file : fs::path(entry.directory) / file;
+}
+
+bool isIRFile(const fs::path& path) {
+    return path.extension() == ".ll" || path.extension() == ".bc";
+}
+
+// Object path under outDir: the entry's "output" if it has one, otherwise
+// its source path with .o, kept relative to the entry's directory.
+fs::path objectPath(const CompileEntry& entry, const fs::path& outDir) {
+    fs::path rel = entry.output.empty() ? fs::path(entry.file) : fs::path(entry.output);
+    if (rel.is_absolute()) {
+        fs::path relative = rel.lexically_relative(entry.directory);
+        rel = relative.empty() || *relative.begin() == ".." ? rel.filename() : relative;
+    } else if (!rel.empty() && *rel.begin() == "..") {
+        rel = rel.filename();
+    }
+    if (entry.output.empty()) rel.replace_extension(".o");
+    return outDir / rel;
+}
+
+// clang invocation from the database entry: same flags, but stop at bitcode.
+std::string compileCommand(const Job& job, const BatchOptions& options) {
+    const std::vector<std::string>& args = job.entry.arguments;
+    std::string command = "cd " + shellQuote(job.entry.directory.empty() ? "." : job.entry.directory) + " && " + options.clang;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        if (a == "-o" || a == "-MF" || a == "-MT" || a == "-MQ") { ++i; continue; }
+        if (a == "-c" || a == "-S" || a == "-E" || a == "-M" || a == "-MM" || a == "-MD" || a == "-MMD" || a == "-MP") continue;
+        if (a.size() > 2 && a.compare(0, 2, "-o") == 0) continue;
+        command += " " + shellQuote(a);
+    }
+    if (args.empty()) command += " " + shellQuote(job.entry.file);
+    command += " -c -emit-llvm " + options.extraCompileFlags + " -o " + shellQuote((job.scratch / "tu.bc").string());
+    command += " 2> " + shellQuote((job.scratch / "compile.log").string());
+    return command;
+}
+
+std::string readLog(const fs::path& path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path.string());
+    if (!buffer) return "";
+    std::string text = (*buffer)->getBuffer().str();
+    size_t end = text.find('\n');
+    return end == std::string::npos ? text : text.substr(0, end);
+}
+
+bool emitObject(llvm::Module& module, const fs::path& object, std::string& error) {
+    std::string triple = module.getTargetTriple();
+    if (triple.empty()) {
+        triple = llvm::sys::getDefaultTargetTriple();
+        module.setTargetTriple(triple);
+    }
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) return false;
+    llvm::TargetOptions targetOptions;
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+        triple, "generic", "", targetOptions, llvm::Reloc::PIC_));
+    module.setDataLayout(machine->createDataLayout());
+
+    std::error_code ec;
+    fs::create_directories(object.parent_path(), ec);
+    llvm::raw_fd_ostream out(object.string(), ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        error = "cannot write " + object.string() + ": " + ec.message();
+        return false;
+    }
+    llvm::legacy::PassManager codegen;
+    if (machine->addPassesToEmitFile(codegen, out, nullptr, llvm::CGFT_ObjectFile)) {
+        error = "target " + triple + " cannot emit object files";
+        return false;
+    }
+    codegen.run(module);
+    return true;
+}
+
+} // namespace
+
+bool runBatch(const BatchOptions& options, BatchReport& report) {
+    std::vector<CompileEntry> entries;
+    std::string error;
+    if (!readCompileCommands(options.compileCommands, entries, error)) {
+        report.errors.push_back(error);
+        return false;
+    }
+    auto loaded = llvm::PassPlugin::Load(options.pluginPath);
+    if (!loaded) {
+        report.errors.push_back("cannot load " + options.pluginPath + ": " + llvm::toString(loaded.takeError()));
+        return false;
+    }
+    const llvm::PassPlugin plugin = *loaded;
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    // Inline asm (fake-loop's barriers) is parsed when the object is emitted.
+    llvm::InitializeNativeTargetAsmParser();
+
+    std::string pipeline;
+    for (const std::string& pass : options.passes) pipeline += (pipeline.empty() ? "" : ",") + pass;
+    // Everything an object depends on besides the TU's own bitcode.
+    std::string cacheContext;
+    if (options.cache)
+        cacheContext = pipeline + "\n" + ObfCache::passEnvironment() + ObfCache::fileDigest(options.pluginPath) +
+                       "\n" + llvm::sys::getDefaultTargetTriple() + " generic pic";
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    report.units = entries.size();
+    report.threads = threads;
+
+    const fs::path outDir(options.outDir);
+    const fs::path scratchRoot = outDir / ".scratch";
+    std::error_code ec;
+    fs::create_directories(scratchRoot, ec);
+
+    std::atomic<uint64_t> busyNs[NumStages];
+    std::atomic<unsigned> tasks[NumStages];
+    for (unsigned s = 0; s < NumStages; ++s) { busyNs[s] = 0; tasks[s] = 0; }
+    std::mutex errorMutex;
+    auto fail = [&](const Job& job, const std::string& message) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        report.errors.push_back(job.entry.file + ": " + message);
+    };
+    // Times one stage of one job; the body returns false on failure.
+    auto timed = [&](Stage stage, const std::function<bool()>& body) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = body();
+        busyNs[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        tasks[stage]++;
+        return ok;
+    };
+
+    WorkStealingPool pool(threads);
+
+    auto codegen = [&](std::shared_ptr<Job> job) {
+        bool ok = timed(Codegen, [&] {
+            std::string message;
+            if (!emitObject(*job->module, job->object, message)) {
+                fail(*job, message);
+                return false;
+            }
+            return true;
+        });
+        if (ok && options.cache) {
+            auto object = llvm::MemoryBuffer::getFile(job->object.string(), /*IsText=*/false, /*RequiresNullTerminator=*/false);
+            if (object) options.cache->store(job->cacheKey, (*object)->getBuffer().str());
+        }
+        job->module.reset();
+        job->context.reset();
+        std::error_code ignored;
+        if (!options.keepScratch) fs::remove_all(job->scratch, ignored);
+    };
+
+    auto obfuscate = [&](std::shared_ptr<Job> job) {
+        bool cached = false;
+        bool ok = timed(Obfuscate, [&] {
+            fs::path input = isIRFile(absoluteFile(job->entry)) ? absoluteFile(job->entry) : job->scratch / "tu.bc";
+            if (options.cache) {
+                std::string object;
+                job->cacheKey = ObfCache::key({"obf-obj-1", ObfCache::fileDigest(input.string()), cacheContext});
+                if (options.cache->lookup(job->cacheKey, object)) {
+                    std::error_code writeError;
+                    fs::create_directories(job->object.parent_path(), writeError);
+                    llvm::raw_fd_ostream out(job->object.string(), writeError, llvm::sys::fs::OF_None);
+                    if (writeError) {
+                        fail(*job, "cannot write " + job->object.string() + ": " + writeError.message());
+                        return false;
+                    }
+                    out << object;
+                    cached = true;
+                    return true;
+                }
+            }
+            job->context = std::make_unique<llvm::LLVMContext>();
+            llvm::SMDiagnostic diag;
+            job->module = llvm::parseIRFile(input.string(), diag, *job->context);
+            if (!job->module) {
+                fail(*job, diag.getMessage().str());
+                return false;
+            }
+            llvm::PassBuilder builder;
+            plugin.registerPassBuilderCallbacks(builder);
+            llvm::LoopAnalysisManager lam;
+            llvm::FunctionAnalysisManager fam;
+            llvm::CGSCCAnalysisManager cgam;
+            llvm::ModuleAnalysisManager mam;
+            builder.registerModuleAnalyses(mam);
+            builder.registerCGSCCAnalyses(cgam);
+            builder.registerFunctionAnalyses(fam);
+            builder.registerLoopAnalyses(lam);
+            builder.crossRegisterProxies(lam, fam, cgam, mam);
+            llvm::ModulePassManager mpm;
+            if (!pipeline.empty()) {
+                if (llvm::Error err = builder.parsePassPipeline(mpm, pipeline)) {
+                    fail(*job, llvm::toString(std::move(err)));
+                    return false;
+                }
+            }
+            mpm.run(*job->module, mam);
+            std::string problems;
+            llvm::raw_string_ostream os(problems);
+            if (llvm::verifyModule(*job->module, &os)) {
+                fail(*job, "invalid IR after obfuscation: " + os.str());
+                return false;
+            }
+            if (options.keepScratch) {
+                std::error_code bcError;
+                llvm::raw_fd_ostream bc((job->scratch / "tu.obf.bc").string(), bcError);
+                if (!bcError) llvm::WriteBitcodeToFile(*job->module, bc);
+            }
+            return true;
+        });
+        if (cached) {
+            std::error_code ignored;
+            if (!options.keepScratch) fs::remove_all(job->scratch, ignored);
+        } else if (ok) {
+            pool.submit([&codegen, job] { codegen(job); });
+        }
+    };
+
+    auto compile = [&](std::shared_ptr<Job> job) {
+        bool ok = true;
+        if (!isIRFile(absoluteFile(job->entry))) {
+            ok = timed(Compile, [&] {
+                if (std::system(compileCommand(*job, options).c_str()) != 0) {
+                    fail(*job, "compile failed: " + readLog(job->scratch / "compile.log"));
+                    return false;
+                }
+                return true;
+            });
+        }
+        if (ok) pool.submit([&obfuscate, job] { obfuscate(job); });
+    };
+
+    // Every job gets its own scratch directory, and object paths are made
+    // unique up front, so no two jobs (or two runs in the same directory
+    // with different out dirs) touch the same file.
+    std::set<fs::path> objects;
+    for (unsigned i = 0; i < entries.size(); ++i) {
+        auto job = std::make_shared<Job>();
+        job->index = i;
+        job->entry = entries[i];
+        job->scratch = scratchRoot / (std::to_string(i) + "-" + fs::path(entries[i].file).stem().string());
+        fs::create_directories(job->scratch, ec);
+        job->object = objectPath(entries[i], outDir);
+        if (!objects.insert(job->object).second)
+            job->object.replace_filename(job->object.stem().string() + "-" + std::to_string(i) + job->object.extension().string());
+        objects.insert(job->object);
+        pool.submit([&compile, job] { compile(job); });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run();
+    report.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    report.steals = pool.steals();
+    report.failed = report.errors.size();
+    for (unsigned s = 0; s < NumStages; ++s)
+        report.stages.push_back({StageNames[s], tasks[s].load(), busyNs[s].load() / 1e6});
+    if (!options.keepScratch) fs::remove(scratchRoot, ec);
+    return true;
+}
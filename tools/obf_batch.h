@@ -0,0 +1,49 @@
+// tools/obf_batch.h - obfuscate every translation unit of a compilation
+// database in parallel (LLVM_OBFSCALTION.exe --batch).
+#pragma once
+
+#include <string>
+#include <vector>
+
+class ObfCache;
+
+struct BatchOptions {
+    std::string compileCommands;   // path of compile_commands.json
+    std::string outDir = "obf-out";
+    std::string pluginPath;
+    // Textual passes run on every TU in this order, one entry per pass and
+    // round, e.g. {"string-obf<cycle=0>", "cff<cycle=0>"}. Rounds are given
+    // as parameters because the jobs share one environment.
+    std::vector<std::string> passes;
+    std::string clang = "clang-14";
+    std::string extraCompileFlags;   // e.g. -fprofile-instr-use=...
+    unsigned threads = 0;            // 0: one per hardware thread
+    bool keepScratch = false;
+    // When set, objects are looked up by the content of the TU's bitcode
+    // before obfuscating and stored after codegen.
+    ObfCache* cache = nullptr;
+};
+
+struct BatchStage {
+    std::string name;
+    unsigned tasks = 0;
+    double busyMs = 0;
+};
+
+struct BatchReport {
+    unsigned units = 0;
+    unsigned failed = 0;
+    unsigned threads = 0;
+    unsigned steals = 0;
+    double wallMs = 0;
+    std::vector<BatchStage> stages;   // compile, obfuscate, codegen
+    std::vector<std::string> errors;  // one line per failed TU
+};
+
+// Runs compile -> obfuscate -> codegen for every entry on a work-stealing
+// pool. Each job gets its own LLVMContext and scratch directory under
+// outDir/.scratch. Objects go to outDir, mirroring the entries' outputs.
+// Entries whose file is already .ll/.bc skip the compile stage, and cache
+// hits skip obfuscation and codegen. Returns false
+// when the database cannot be read or the plugin cannot be loaded.
+bool runBatch(const BatchOptions& options, BatchReport& report);
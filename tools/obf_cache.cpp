@@ -0,0 +1,153 @@
+// tools/obf_cache.cpp - see obf_cache.h.
+#include "obf_cache.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SHA1.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#include <stdlib.h>
+#define getpid _getpid
+#define environ _environ
+#else
+#include <unistd.h>
+extern char** environ;
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const TempMarker = ".tmp.";
+
+std::string digest(llvm::SHA1& hasher) {
+    return llvm::toHex(llvm::arrayRefFromStringRef(hasher.final()), true);
+}
+
+} // namespace
+
+ObfCache::ObfCache(std::string dir, uint64_t maxBytes) : dir(std::move(dir)), maxBytes(maxBytes) {
+    std::error_code ec;
+    fs::create_directories(this->dir, ec);
+}
+
+std::string ObfCache::key(const std::vector<std::string>& parts) {
+    llvm::SHA1 hasher;
+    for (const std::string& part : parts) {
+        hasher.update(std::to_string(part.size()) + ":");
+        hasher.update(part);
+    }
+    return digest(hasher);
+}
+
+std::string ObfCache::fileDigest(const std::string& path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!buffer) return "";
+    llvm::SHA1 hasher;
+    hasher.update((*buffer)->getBuffer());
+    return digest(hasher);
+}
+
+std::string ObfCache::passEnvironment() {
+    std::vector<std::string> vars;
+    for (char** env = environ; env && *env; ++env) {
+        if (std::strncmp(*env, "LLVM_OBF_", 9) != 0 || std::strncmp(*env, "LLVM_OBF_CYCLE=", 15) == 0) continue;
+        vars.push_back(*env);
+    }
+    std::sort(vars.begin(), vars.end());
+    std::string text;
+    for (const std::string& var : vars) text += var + "\n";
+    return text;
+}
+
+std::string ObfCache::entryPath(const std::string& key) const {
+    return (fs::path(dir) / key.substr(0, 2) / key).string();
+}
+
+bool ObfCache::lookup(const std::string& key, std::string& data) {
+    const std::string path = entryPath(key);
+    auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!buffer) {
+        missCount++;
+        return false;
+    }
+    data = (*buffer)->getBuffer().str();
+    // The modification time doubles as the last-use time for prune(). The
+    // entry may have been evicted meanwhile; the data read above is complete
+    // either way.
+    std::error_code ignored;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ignored);
+    hitCount++;
+    return true;
+}
+
+bool ObfCache::store(const std::string& key, const std::string& data) {
+    static std::atomic<unsigned> counter{0};
+    const fs::path path = entryPath(key);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    // Unique per process, thread and call, in the same directory so that the
+    // rename cannot cross file systems.
+    const fs::path temp = path.string() + TempMarker + std::to_string(getpid()) + "." +
+                          std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+                          std::to_string(counter++);
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+        out.close();
+        if (!out) {
+            fs::remove(temp, ec);
+            return false;
+        }
+    }
+    fs::rename(temp, path, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return false;
+    }
+    storeCount++;
+    return true;
+}
+
+void ObfCache::prune() {
+    struct Entry {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type used;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    const auto now = fs::file_time_type::clock::now();
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code statError;
+        if (!it->is_regular_file(statError)) continue;
+        Entry entry{it->path(), it->file_size(statError), it->last_write_time(statError)};
+        if (statError) continue;
+        // Another run may still be writing a fresh temporary.
+        if (entry.path.filename().string().find(TempMarker) != std::string::npos) {
+            if (now - entry.used > std::chrono::hours(1)) fs::remove(entry.path, statError);
+            continue;
+        }
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    if (total <= maxBytes) return;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const Entry& entry : entries) {
+        if (total <= maxBytes) break;
+        std::error_code removeError;
+        // Losing the race against another run's prune still frees the space.
+        if (fs::remove(entry.path, removeError)) evictionCount++;
+        total -= entry.size;
+    }
+}
@@ -0,0 +1,51 @@
+// tools/obf_cache.h - content-addressed on-disk cache of obfuscation results,
+// shared by single runs and --batch jobs.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ObfCache {
+public:
+    // Entries live under dir/<2 hex>/<key>; maxBytes bounds the total size.
+    ObfCache(std::string dir, uint64_t maxBytes);
+
+    // SHA-1 over the parts, each length-prefixed so that ("ab", "c") and
+    // ("a", "bc") differ.
+    static std::string key(const std::vector<std::string>& parts);
+    // SHA-1 of a file's contents, "" if it cannot be read. Used for the input
+    // and the plugin (its build id: a rebuilt plugin invalidates everything).
+    static std::string fileDigest(const std::string& path);
+    // Every LLVM_OBF_* variable except LLVM_OBF_CYCLE, sorted, one per line.
+    // The passes take their parameters from these; the round is part of the
+    // pipeline text instead.
+    static std::string passEnvironment();
+
+    // On a hit fills data and marks the entry as recently used.
+    bool lookup(const std::string& key, std::string& data);
+    // Writes to a temporary file next to the entry and renames it into
+    // place, so concurrent readers and writers of one key never see a partial
+    // entry. Returns false (and counts nothing) if the write fails.
+    bool store(const std::string& key, const std::string& data);
+    // Removes least recently used entries until the cache fits in maxBytes,
+    // plus temporaries that writers left behind.
+    void prune();
+
+    const std::string& directory() const { return dir; }
+    unsigned hits() const { return hitCount.load(); }
+    unsigned misses() const { return missCount.load(); }
+    unsigned stores() const { return storeCount.load(); }
+    unsigned evictions() const { return evictionCount.load(); }
+
+private:
+    std::string entryPath(const std::string& key) const;
+
+    std::string dir;
+    uint64_t maxBytes;
+    std::atomic<unsigned> hitCount{0};
+    std::atomic<unsigned> missCount{0};
+    std::atomic<unsigned> storeCount{0};
+    std::atomic<unsigned> evictionCount{0};
+};
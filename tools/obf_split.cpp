@@ -0,0 +1,146 @@
+// tools/obf_split.cpp - see obf_split.h.
+#include "obf_split.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::string toBitcode(const llvm::Module& M) {
+    std::string bitcode;
+    llvm::raw_string_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(M, os);
+    return os.str();
+}
+
+// Runs the pipeline on one serialized partition in a private context and
+// serializes the result back into the same string.
+bool runPartition(std::string& bitcode, const SplitOptions& options, std::string& error) {
+    llvm::LLVMContext context;
+    auto parsed = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bitcode, "partition"), context);
+    if (!parsed) {
+        error = llvm::toString(parsed.takeError());
+        return false;
+    }
+    std::unique_ptr<llvm::Module> part = std::move(*parsed);
+    llvm::PassBuilder builder;
+    options.plugin->registerPassBuilderCallbacks(builder);
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    builder.registerModuleAnalyses(mam);
+    builder.registerCGSCCAnalyses(cgam);
+    builder.registerFunctionAnalyses(fam);
+    builder.registerLoopAnalyses(lam);
+    builder.crossRegisterProxies(lam, fam, cgam, mam);
+    llvm::ModulePassManager mpm;
+    if (!options.pipeline.empty()) {
+        if (llvm::Error err = builder.parsePassPipeline(mpm, options.pipeline)) {
+            error = llvm::toString(std::move(err));
+            return false;
+        }
+    }
+    mpm.run(*part, mam);
+    llvm::raw_string_ostream os(error);
+    if (llvm::verifyModule(*part, &os)) {
+        os.flush();
+        error = "invalid IR: " + error;
+        return false;
+    }
+    bitcode = toBitcode(*part);
+    return true;
+}
+
+} // namespace
+
+std::unique_ptr<llvm::Module> runSplit(std::unique_ptr<llvm::Module> M, const SplitOptions& options,
+                                       SplitReport& report) {
+    const unsigned parts = std::max(1u, options.parts);
+    const unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    report.threads = threads;
+
+    // Partitions share M's context, so they are serialized here and each job
+    // parses its own copy into a fresh context.
+    auto start = Clock::now();
+    std::vector<std::string> partitions;
+    llvm::SplitModule(*M, parts, [&](std::unique_ptr<llvm::Module> part) {
+        // Every partition gets a copy of the module asm; keep one.
+        if (!partitions.empty()) part->setModuleInlineAsm("");
+        partitions.push_back(toBitcode(*part));
+    }, /*PreserveLocals=*/true);
+    report.parts = partitions.size();
+    report.splitMs = msSince(start);
+
+    // Partitions are independent, so the workers simply take the next index.
+    start = Clock::now();
+    std::atomic<unsigned> next{0};
+    std::atomic<uint64_t> busyNs{0};
+    std::mutex errorMutex;
+    auto worker = [&] {
+        for (unsigned i = next++; i < partitions.size(); i = next++) {
+            auto begin = Clock::now();
+            std::string error;
+            bool ok = runPartition(partitions[i], options, error);
+            busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+            if (!ok) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                report.errors.push_back("partition " + std::to_string(i) + ": " + error);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < std::min<size_t>(threads, partitions.size()); ++t) workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers) w.join();
+    report.runMs = msSince(start);
+    report.busyMs = busyNs.load() / 1e6;
+    if (!report.errors.empty()) return nullptr;
+
+    // Linking in partition order keeps the result independent of which
+    // thread finished first. Private symbols the passes added to several
+    // partitions (e.g. __obf_opaque_state) are renamed apart by the linker.
+    start = Clock::now();
+    llvm::LLVMContext& context = M->getContext();
+    auto merged = std::make_unique<llvm::Module>(M->getModuleIdentifier(), context);
+    merged->setSourceFileName(M->getSourceFileName());
+    merged->setDataLayout(M->getDataLayout());
+    merged->setTargetTriple(M->getTargetTriple());
+    M.reset();
+    llvm::Linker linker(*merged);
+    for (unsigned i = 0; i < partitions.size(); ++i) {
+        auto part = llvm::parseBitcodeFile(llvm::MemoryBufferRef(partitions[i], "partition"), context);
+        if (!part) {
+            report.errors.push_back("partition " + std::to_string(i) + ": " + llvm::toString(part.takeError()));
+            return nullptr;
+        }
+        if (linker.linkInModule(std::move(*part))) {
+            report.errors.push_back("partition " + std::to_string(i) + ": link failed");
+            return nullptr;
+        }
+    }
+    report.linkMs = msSince(start);
+    return merged;
+}
@@ -0,0 +1,39 @@
+// tools/obf_split.h - obfuscate one large module on several threads by
+// splitting it into partitions (LLVM_OBFSCALTION.exe --split).
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+class PassPlugin;
+} // namespace llvm
+
+struct SplitOptions {
+    // Number of partitions. The output depends on it, never on threads.
+    unsigned parts = 8;
+    unsigned threads = 0;   // 0: one per hardware thread
+    // Textual pipeline run on every partition, rounds given as <cycle=N>.
+    std::string pipeline;
+    const llvm::PassPlugin* plugin = nullptr;
+};
+
+struct SplitReport {
+    unsigned parts = 0;
+    unsigned threads = 0;
+    double splitMs = 0;     // partitioning and serializing
+    double runMs = 0;       // wall time of the parallel pipeline runs
+    double busyMs = 0;      // sum of the partitions' pipeline times
+    double linkMs = 0;      // reading back and linking
+    std::vector<std::string> errors;
+};
+
+// Splits M by function with llvm::SplitModule, keeping local symbols in the
+// partition of their users, runs the pipeline on each partition in its own
+// LLVMContext on a pool of threads, and links the results back in partition
+// order into a module in M's context. Returns null (with report.errors set)
+// if a partition fails to parse, run, verify or link.
+std::unique_ptr<llvm::Module> runSplit(std::unique_ptr<llvm::Module> M, const SplitOptions& options,
+                                       SplitReport& report);
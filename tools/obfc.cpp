@@ -0,0 +1,120 @@
+// tools/obfc.cpp - thin client for obfd, meant to replace an `opt` call in a
+// build rule:
+//
+//   obfc [--socket PATH] [--passes PIPELINE] [-e NAME=VALUE]... <in> -o <out>
+//   obfc [--socket PATH] --stats | --shutdown
+//
+// <in> and <out> may be "-" for stdin/stdout. Every LLVM_OBF_* variable of
+// the client's environment is forwarded, so a build configures the passes
+// the same way as under opt; -e adds or overrides one. It does not link
+// LLVM, so starting it costs about as much as starting cat.
+
+#include "obfd_protocol.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+extern char** environ;
+
+namespace {
+
+int usage() {
+    std::cerr << "usage: obfc [--socket PATH] [--passes PIPELINE] [-e NAME=VALUE]... <input> -o <output>\n"
+                 "       obfc [--socket PATH] --stats | --shutdown\n";
+    return 2;
+}
+
+bool readInput(const std::string& path, std::string& data) {
+    if (path == "-") {
+        data.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        return true;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool writeOutput(const std::string& path, const std::string& data) {
+    if (path == "-") {
+        std::cout.write(data.data(), data.size());
+        return bool(std::cout.flush());
+    }
+    // Written next to the target and renamed, so a failed or interrupted run
+    // never leaves a truncated output for the build system to trust.
+    std::string temp = path + ".obfc-" + std::to_string(getpid());
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    out.close();
+    if (!out || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string socketPath = obfd::defaultSocket();
+    std::string passes = "string-obf,bogus-insert,fake-loop,cff";
+    std::string input, output, command = "RUN";
+    std::vector<std::string> env;
+    for (char** e = environ; e && *e; ++e)
+        if (std::strncmp(*e, "LLVM_OBF_", 9) == 0) env.push_back(*e);
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--socket" && hasValue) socketPath = argv[++i];
+        else if (arg == "--passes" && hasValue) passes = argv[++i];
+        else if (arg == "-e" && hasValue) env.push_back(argv[++i]);
+        else if (arg == "-o" && hasValue) output = argv[++i];
+        else if (arg == "--stats") command = "STATS";
+        else if (arg == "--shutdown") command = "SHUTDOWN";
+        else if (input.empty() && (arg == "-" || arg[0] != '-')) input = arg;
+        else return usage();
+    }
+    if (command == "RUN" && (input.empty() || output.empty())) return usage();
+
+    std::ostringstream request;
+    request << "OBF1 " << command << "\n";
+    std::string payload;
+    if (command == "RUN") {
+        if (!readInput(input, payload)) {
+            std::cerr << "obfc: cannot read " << input << "\n";
+            return 1;
+        }
+        request << "passes " << passes << "\n";
+        for (const std::string& setting : env) request << "env " << setting << "\n";
+    }
+    request << "size " << payload.size() << "\n\n";
+
+    sockaddr_un addr;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!obfd::socketAddress(socketPath, addr) ||
+        ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        std::cerr << "obfc: cannot connect to obfd at " << socketPath << ": " << std::strerror(errno) << "\n";
+        return 3;
+    }
+    obfd::Reader in(fd);
+    bool ok = false;
+    std::string body;
+    if (!obfd::writeAll(fd, request.str()) || !obfd::writeAll(fd, payload) || !obfd::readResponse(in, ok, body)) {
+        std::cerr << "obfc: connection to " << socketPath << " lost\n";
+        return 3;
+    }
+    ::close(fd);
+    if (!ok) {
+        std::cerr << "obfc: " << body << "\n";
+        return 1;
+    }
+    if (command == "STATS") std::cout << body;
+    if (command == "RUN" && !writeOutput(output, body)) {
+        std::cerr << "obfc: cannot write " << output << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,363 @@
+// tools/obfd.cpp - obfuscation server.
+// Like inproc_obf it runs a textual pipeline from libObfPasses.so on in-memory
+// IR, but it stays up: LLVM is initialized and the plugin loaded once, and
+// requests (bitcode plus pipeline, see obfd_protocol.h) arrive over a Unix
+// domain socket and are served concurrently by a pool of workers. The STATS
+// request returns per-phase latency histograms. obfc is the matching client.
+
+#include "obfd_protocol.h"
+
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <set>
+#include <sys/stat.h>
+#include <thread>
+
+using namespace llvm;
+
+static cl::opt<std::string> SocketPath("socket", cl::desc("Unix socket to listen on (default: $OBFD_SOCKET or /tmp/obfd-<uid>.sock)"));
+static cl::opt<std::string> PluginPath("plugin", cl::desc("Path to plugin"), cl::init("./libObfPasses.so"));
+static cl::opt<unsigned> Jobs("jobs", cl::desc("Worker threads (0: one per hardware thread)"), cl::init(0));
+static cl::opt<std::string> LogPath("log", cl::desc("Send the passes' log here instead of stderr"));
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double usSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// Power-of-two buckets: bucket i counts latencies below 2^i microseconds
+// (and at least 2^(i-1)), so 32 buckets reach about 36 minutes.
+class LatencyHistogram {
+public:
+    void add(double us) {
+        uint64_t v = us < 1 ? 1 : static_cast<uint64_t>(us);
+        unsigned bucket = 0;
+        while (bucket < NumBuckets - 1 && (uint64_t(1) << bucket) <= v) ++bucket;
+        buckets[bucket]++;
+        count++;
+        sumUs += v;
+        uint64_t seen = maxUs.load();
+        while (v > seen && !maxUs.compare_exchange_weak(seen, v)) {}
+    }
+
+    // Upper bound of the bucket holding the given quantile, capped at the
+    // largest latency seen.
+    uint64_t quantile(double q) const {
+        uint64_t total = count.load(), seen = 0;
+        if (!total) return 0;
+        for (unsigned i = 0; i < NumBuckets; ++i) {
+            seen += buckets[i].load();
+            if (seen >= q * total) return std::min(uint64_t(1) << i, maxUs.load());
+        }
+        return maxUs.load();
+    }
+
+    void writeJSON(raw_ostream& os) const {
+        uint64_t n = count.load();
+        os << "{\"count\": " << n << ", \"mean_us\": " << (n ? sumUs.load() / n : 0)
+           << ", \"p50_us\": " << quantile(0.5) << ", \"p90_us\": " << quantile(0.9)
+           << ", \"p99_us\": " << quantile(0.99) << ", \"max_us\": " << maxUs.load() << ", \"buckets\": {";
+        bool first = true;
+        for (unsigned i = 0; i < NumBuckets; ++i) {
+            if (!buckets[i].load()) continue;
+            os << (first ? "" : ", ") << "\"<" << (uint64_t(1) << i) << "\": " << buckets[i].load();
+            first = false;
+        }
+        os << "}}";
+    }
+
+private:
+    static constexpr unsigned NumBuckets = 32;
+    std::atomic<uint64_t> buckets[NumBuckets] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumUs{0};
+    std::atomic<uint64_t> maxUs{0};
+};
+
+enum Phase { Total, Parse, Build, Passes, Emit, NumPhases };
+const char* const PhaseNames[NumPhases] = {"total", "parse", "build", "passes", "emit"};
+
+struct Server {
+    PassPlugin plugin;
+    unsigned threads;
+    Clock::time_point started = Clock::now();
+    LatencyHistogram latency[NumPhases];
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<unsigned> inFlight{0};
+    // Every pass reads its settings (LLVM_OBF_*, OFILE) from the environment
+    // in its constructor and never in run(). So each request's values are
+    // applied, the pipeline built and the environment restored under this
+    // lock, and running the pipelines needs no lock.
+    std::mutex envMutex;
+
+    // Accepted connections waiting for a worker, and those being served.
+    std::mutex connMutex;
+    std::condition_variable connReady;
+    std::deque<int> pending;
+    std::set<int> active;
+    bool stopping = false;
+
+    explicit Server(PassPlugin plugin, unsigned threads) : plugin(plugin), threads(threads) {}
+};
+
+std::atomic<int> ListenFd{-1};
+
+void onSignal(int) {
+    int fd = ListenFd.load();
+    if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+}
+
+bool buildPipeline(Server& server, const obfd::Request& request, PassBuilder& builder,
+                   ModulePassManager& mpm, std::string& error) {
+    std::lock_guard<std::mutex> lock(server.envMutex);
+    std::vector<std::pair<std::string, const char*>> saved;
+    std::vector<std::string> savedValues;
+    savedValues.reserve(request.env.size());
+    for (const std::string& setting : request.env) {
+        size_t eq = setting.find('=');
+        if (setting.compare(0, 9, "LLVM_OBF_") != 0 || eq == std::string::npos) {
+            error = "only LLVM_OBF_<NAME>=<value> settings are accepted, got '" + setting + "'";
+            break;
+        }
+        std::string name = setting.substr(0, eq);
+        const char* old = std::getenv(name.c_str());
+        savedValues.push_back(old ? old : "");
+        saved.push_back({name, old ? savedValues.back().c_str() : nullptr});
+        ::setenv(name.c_str(), setting.c_str() + eq + 1, 1);
+    }
+    if (error.empty()) {
+        // The plugin's extension points read LLVM_OBF_EP here too.
+        server.plugin.registerPassBuilderCallbacks(builder);
+        if (Error err = builder.parsePassPipeline(mpm, request.passes))
+            error = "bad pipeline '" + request.passes + "': " + toString(std::move(err));
+    }
+    for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+        if (it->second) ::setenv(it->first.c_str(), it->second, 1);
+        else ::unsetenv(it->first.c_str());
+    }
+    return error.empty();
+}
+
+bool runRequest(Server& server, const obfd::Request& request, std::string& response) {
+    auto start = Clock::now();
+    double phase[NumPhases] = {};
+    LLVMContext context;
+    SMDiagnostic diag;
+    std::unique_ptr<Module> module = parseIR(MemoryBufferRef(request.payload, "request"), diag, context);
+    if (!module) {
+        raw_string_ostream os(response);
+        diag.print("obfd", os);
+        return false;
+    }
+    phase[Parse] = usSince(start);
+
+    auto step = Clock::now();
+    PassBuilder builder;
+    LoopAnalysisManager lam;
+    FunctionAnalysisManager fam;
+    CGSCCAnalysisManager cgam;
+    ModuleAnalysisManager mam;
+    ModulePassManager mpm;
+    if (!buildPipeline(server, request, builder, mpm, response)) return false;
+    builder.registerModuleAnalyses(mam);
+    builder.registerCGSCCAnalyses(cgam);
+    builder.registerFunctionAnalyses(fam);
+    builder.registerLoopAnalyses(lam);
+    builder.crossRegisterProxies(lam, fam, cgam, mam);
+    phase[Build] = usSince(step);
+
+    step = Clock::now();
+    mpm.run(*module, mam);
+    {
+        std::string problems;
+        raw_string_ostream os(problems);
+        if (verifyModule(*module, &os)) {
+            response = "invalid IR after '" + request.passes + "': " + os.str();
+            return false;
+        }
+    }
+    phase[Passes] = usSince(step);
+
+    step = Clock::now();
+    raw_string_ostream os(response);
+    WriteBitcodeToFile(*module, os);
+    os.flush();
+    phase[Emit] = usSince(step);
+
+    phase[Total] = usSince(start);
+    for (unsigned p = 0; p < NumPhases; ++p) server.latency[p].add(phase[p]);
+    return true;
+}
+
+std::string statsJSON(Server& server) {
+    std::string json;
+    raw_string_ostream os(json);
+    os << "{\n  \"uptime_s\": " << static_cast<uint64_t>(usSince(server.started) / 1e6)
+       << ",\n  \"threads\": " << server.threads << ",\n  \"requests\": " << server.requests.load()
+       << ",\n  \"errors\": " << server.errors.load() << ",\n  \"in_flight\": " << server.inFlight.load()
+       << ",\n  \"latency_us\": {";
+    for (unsigned p = 0; p < NumPhases; ++p) {
+        os << (p ? ",\n    \"" : "\n    \"") << PhaseNames[p] << "\": ";
+        server.latency[p].writeJSON(os);
+    }
+    os << "\n  }\n}\n";
+    return os.str();
+}
+
+// Serves one connection until the client closes it or sends SHUTDOWN.
+void serve(Server& server, int fd) {
+    obfd::Reader in(fd);
+    obfd::Request request;
+    std::string error;
+    while (obfd::readRequest(in, request, error)) {
+        if (request.command == "STATS") {
+            if (!obfd::writeResponse(fd, true, statsJSON(server))) break;
+            continue;
+        }
+        if (request.command == "SHUTDOWN") {
+            obfd::writeResponse(fd, true, "");
+            onSignal(0);
+            break;
+        }
+        if (request.command != "RUN") {
+            error = "unknown command '" + request.command + "'";
+            break;
+        }
+        server.requests++;
+        server.inFlight++;
+        std::string response;
+        bool ok = runRequest(server, request, response);
+        server.inFlight--;
+        if (!ok) server.errors++;
+        if (!obfd::writeResponse(fd, ok, response)) break;
+    }
+    if (!error.empty()) {
+        server.errors++;
+        obfd::writeResponse(fd, false, error);
+    }
+}
+
+void worker(Server& server) {
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(server.connMutex);
+            server.connReady.wait(lock, [&] { return server.stopping || !server.pending.empty(); });
+            if (server.pending.empty()) return;
+            fd = server.pending.front();
+            server.pending.pop_front();
+            server.active.insert(fd);
+        }
+        serve(server, fd);
+        {
+            std::lock_guard<std::mutex> lock(server.connMutex);
+            server.active.erase(fd);
+        }
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "obfd - obfuscation server\n");
+    const std::string path = SocketPath.empty() ? obfd::defaultSocket() : SocketPath.getValue();
+
+    auto loaded = PassPlugin::Load(PluginPath);
+    if (!loaded) {
+        errs() << "obfd: cannot load " << PluginPath << ": " << toString(loaded.takeError()) << "\n";
+        return 1;
+    }
+    if (!LogPath.empty()) {
+        int log = ::open(LogPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (log < 0) {
+            errs() << "obfd: cannot open " << LogPath << "\n";
+            return 1;
+        }
+        ::dup2(log, 2);
+        ::close(log);
+    }
+
+    sockaddr_un addr;
+    if (!obfd::socketAddress(path, addr)) {
+        errs() << "obfd: socket path too long: " << path << "\n";
+        return 1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // A socket file nobody answers on is left over from a dead server.
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0) {
+        errs() << "obfd: a server is already listening on " << path << "\n";
+        return 1;
+    }
+    ::close(fd);
+    ::unlink(path.c_str());
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 || ::listen(fd, 128) != 0) {
+        errs() << "obfd: cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    ::chmod(path.c_str(), 0600);
+    ListenFd = fd;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    unsigned threads = Jobs ? Jobs.getValue() : std::max(1u, std::thread::hardware_concurrency());
+    Server server(*loaded, threads);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) workers.emplace_back(worker, std::ref(server));
+    outs() << "obfd: listening on " << path << " with " << threads << " workers\n";
+    outs().flush();
+
+    while (true) {
+        int conn = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        std::lock_guard<std::mutex> lock(server.connMutex);
+        server.pending.push_back(conn);
+        server.connReady.notify_one();
+    }
+
+    // Stop taking requests: idle connections see end of stream, requests
+    // already read still get their response.
+    {
+        std::lock_guard<std::mutex> lock(server.connMutex);
+        server.stopping = true;
+        for (int conn : server.active) ::shutdown(conn, SHUT_RD);
+        for (int conn : server.pending) ::close(conn);
+        server.pending.clear();
+    }
+    server.connReady.notify_all();
+    for (auto& w : workers) w.join();
+    ::close(fd);
+    ::unlink(path.c_str());
+    outs() << "obfd: served " << server.requests.load() << " requests (" << server.errors.load() << " failed)\n";
+    return 0;
+}
@@ -0,0 +1,169 @@
+// tools/obfd_protocol.h - wire format shared by obfd and obfc. Plain POSIX,
+// no LLVM, so the client starts as fast as a shell utility.
+//
+// A connection carries any number of requests, one after the other:
+//
+//   OBF1 RUN | STATS | SHUTDOWN\n
+//   passes <textual pipeline>\n        (RUN)
+//   env LLVM_OBF_<NAME>=<value>\n      (RUN, any number)
+//   size <N>\n
+//   \n
+//   <N bytes: bitcode or textual IR>
+//
+// and each gets one response:
+//
+//   OK <N>\n<N bytes>                  bitcode (RUN), JSON (STATS)
+//   ERR <N>\n<N bytes>                 message
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+namespace obfd {
+
+// OBFD_SOCKET, or a per-user path in /tmp.
+inline std::string defaultSocket() {
+    if (const char* env = std::getenv("OBFD_SOCKET")) return env;
+    return "/tmp/obfd-" + std::to_string(getuid()) + ".sock";
+}
+
+inline bool writeAll(int fd, const char* data, size_t size) {
+    while (size) {
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool writeAll(int fd, const std::string& data) { return writeAll(fd, data.data(), data.size()); }
+
+// Buffered reader over a socket: lines for the headers, exact byte counts
+// for the payload.
+class Reader {
+public:
+    explicit Reader(int fd) : fd(fd) {}
+
+    // False at end of stream or on error. The '\n' is dropped.
+    bool line(std::string& out) {
+        out.clear();
+        while (true) {
+            for (; pos < buffer.size(); ++pos) {
+                if (buffer[pos] == '\n') {
+                    ++pos;
+                    compact();
+                    return true;
+                }
+                out += buffer[pos];
+            }
+            pos = buffer.size();
+            if (out.size() > 1 << 20 || !fill()) return false;
+        }
+    }
+
+    bool bytes(size_t count, std::string& out) {
+        out.clear();
+        out.reserve(count);
+        while (out.size() < count) {
+            if (pos == buffer.size() && !fill()) return false;
+            size_t take = std::min(count - out.size(), buffer.size() - pos);
+            out.append(buffer, pos, take);
+            pos += take;
+        }
+        compact();
+        return true;
+    }
+
+private:
+    bool fill() {
+        char chunk[65536];
+        ssize_t n;
+        do n = ::recv(fd, chunk, sizeof chunk, 0); while (n < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+        return true;
+    }
+
+    void compact() {
+        if (pos == buffer.size()) {
+            buffer.clear();
+            pos = 0;
+        }
+    }
+
+    int fd;
+    std::string buffer;
+    size_t pos = 0;
+};
+
+struct Request {
+    std::string command;   // RUN, STATS or SHUTDOWN
+    std::string passes;
+    std::vector<std::string> env;   // NAME=VALUE
+    std::string payload;
+};
+
+// Reads one request. False at a clean end of stream, or with error set when
+// the request is malformed.
+inline bool readRequest(Reader& in, Request& request, std::string& error) {
+    request = Request();
+    std::string line;
+    if (!in.line(line)) return false;
+    if (line.compare(0, 5, "OBF1 ") != 0) {
+        error = "expected 'OBF1 <command>', got '" + line.substr(0, 40) + "'";
+        return false;
+    }
+    request.command = line.substr(5);
+    size_t size = 0;
+    while (true) {
+        if (!in.line(line)) {
+            error = "connection closed inside a request header";
+            return false;
+        }
+        if (line.empty()) break;
+        if (line.compare(0, 7, "passes ") == 0) request.passes = line.substr(7);
+        else if (line.compare(0, 4, "env ") == 0) request.env.push_back(line.substr(4));
+        else if (line.compare(0, 5, "size ") == 0) size = std::strtoull(line.c_str() + 5, nullptr, 10);
+        else {
+            error = "unknown header '" + line.substr(0, 40) + "'";
+            return false;
+        }
+    }
+    if (size && !in.bytes(size, request.payload)) {
+        error = "connection closed inside a request body";
+        return false;
+    }
+    return true;
+}
+
+inline bool writeResponse(int fd, bool ok, const std::string& body) {
+    return writeAll(fd, std::string(ok ? "OK " : "ERR ") + std::to_string(body.size()) + "\n") &&
+           writeAll(fd, body);
+}
+
+// False when the connection broke; ok tells OK from ERR.
+inline bool readResponse(Reader& in, bool& ok, std::string& body) {
+    std::string line;
+    if (!in.line(line)) return false;
+    ok = line.compare(0, 3, "OK ") == 0;
+    if (!ok && line.compare(0, 4, "ERR ") != 0) return false;
+    return in.bytes(std::strtoull(line.c_str() + (ok ? 3 : 4), nullptr, 10), body);
+}
+
+inline bool socketAddress(const std::string& path, sockaddr_un& addr) {
+    addr = sockaddr_un();
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr.sun_path) return false;
+    path.copy(addr.sun_path, path.size());
+    return true;
+}
+
+} // namespace obfd
@@ -12,6 +12,32 @@
 #include <limits>  // Required for std::numeric_limits
 #include <filesystem> // For getting absolute paths and file size
 #include <iomanip> // For std::setprecision
+#include <memory>
+#include <cstdio>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "passes/ObfMetrics.h"
+#include "obf_batch.h"
+#include "obf_cache.h"
+#include "obf_split.h"
 
 // --- UI Components ---
 #ifdef _WIN32
@@ -81,15 +107,141 @@ struct ObfuscationConfig {
     int fakeLoopCycles = 1;
     uint32_t seed = 0;
     std::string presetName = "Light";
+    // Profile used to go easy on hot code (see LLVM_OBF_HOT_PERCENTILE):
+    // an indexed .profdata from -fprofile-instr-generate runs, or a sample
+    // profile when sampleProfile is set.
+    std::string profileFile;
+    bool sampleProfile = false;
+    // Run the passes inside this process on one in-memory module (default),
+    // or spawn opt-14 once per pass and cycle as older versions did.
+    bool inProcess = true;
+    std::string pluginPath = "./build/libObfPasses.so";
+    // When set, the before/after metrics are also written here as JSON.
+    std::string metricsFile;
+    // Content-addressed result cache (tools/obf_cache.h); empty disables it.
+    std::string cacheDir;
+    uint64_t cacheMaxBytes = 1024ull << 20;
+    // Worker threads for --batch and --split; 0 means one per hardware thread.
+    unsigned jobs = 0;
+    // When non-zero, the module is split into this many partitions that are
+    // obfuscated in parallel (tools/obf_split.h). In-process pipeline only.
+    unsigned splitParts = 0;
 };
 
+// Textual pipeline of the enabled passes in the order they run, one entry
+// per round. Batch jobs run it as is; the cache keys on it.
+std::vector<std::string> passPipeline(const ObfuscationConfig& config) {
+    std::vector<std::string> passes;
+    auto addPass = [&](const std::string& flag, bool enabled, int cycles) {
+        if (!enabled) return;
+        for (int i = 0; i < cycles; ++i) passes.push_back(flag + "<cycle=" + std::to_string(i) + ">");
+    };
+    addPass("string-obf", config.stringObfuscation, config.stringObfCycles);
+    addPass("bogus-insert", config.bogusControlFlow, config.bogusControlFlowCycles);
+    addPass("fake-loop", config.fakeLoops, config.fakeLoopCycles);
+    addPass("cff", config.controlFlowFlattening, config.flatteningCycles);
+    return passes;
+}
+
 struct ObfuscationResult {
     bool success = false;
     std::map<std::string, long long> stats;
     std::map<std::string, long long> initialAnalysis;
     std::map<std::string, long long> finalAnalysis;
+    ObfModuleMetrics initialMetrics;
+    ObfModuleMetrics finalMetrics;
+    // Wall time of each step in milliseconds, in the order they ran.
+    std::vector<std::pair<std::string, double>> timings;
+    int processLaunches = 0;
+    // Where the intermediates were kept, when asked to keep them.
+    std::string scratchDir;
+    // "hit", "miss" or empty when the cache is off.
+    std::string cacheResult;
+    unsigned cacheEvictions = 0;
+    // With --split: summed pipeline time of all partitions.
+    double splitBusyMs = 0;
 };
 
+// Times one step of performObfuscation and appends it to the result.
+class StepTimer {
+    std::vector<std::pair<std::string, double>>& timings;
+    std::string name;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+public:
+    StepTimer(ObfuscationResult& result, std::string step) : timings(result.timings), name(std::move(step)) {}
+    ~StepTimer() {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        timings.emplace_back(name, elapsed.count());
+    }
+};
+
+void setEnv(const char* name, const std::string& value) {
+#ifdef _WIN32
+    _putenv_s(name, value.c_str());
+#else
+    setenv(name, value.c_str(), 1);
+#endif
+}
+
+// Sets name only when the user has not: their settings win over the CLI's.
+void setEnvDefault(const char* name, const std::string& value) {
+    if (!std::getenv(name))
+        setEnv(name, value);
+}
+
+void unsetEnv(const char* name) {
+#ifdef _WIN32
+    _putenv_s(name, "");
+#else
+    unsetenv(name);
+#endif
+}
+
+// Sends stderr to a file while alive, the in-process equivalent of `2> file`
+// (the passes log through llvm::errs()).
+class StderrToFile {
+    int saved = -1;
+public:
+    explicit StderrToFile(const std::string& path) {
+        std::fflush(stderr);
+#ifdef _WIN32
+        int fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC, 0644);
+        if (fd < 0) return;
+        saved = _dup(2); _dup2(fd, 2); _close(fd);
+#else
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return;
+        saved = dup(2); dup2(fd, 2); close(fd);
+#endif
+    }
+    ~StderrToFile() {
+        if (saved < 0) return;
+        std::fflush(stderr);
+#ifdef _WIN32
+        _dup2(saved, 2); _close(saved);
+#else
+        dup2(saved, 2); close(saved);
+#endif
+    }
+};
+
+// A fresh directory under the system temp directory for one run.
+std::filesystem::path makeScratchDir() {
+    std::random_device rd;
+    std::filesystem::path dir;
+    do {
+        std::stringstream name;
+        name << "obf-" << std::hex << rd() << rd();
+        dir = std::filesystem::temp_directory_path() / name.str();
+    } while (!std::filesystem::create_directories(dir));
+    return dir;
+}
+
+bool isIRFile(const std::string& path) {
+    std::string ext = std::filesystem::path(path).extension().string();
+    return ext == ".ll" || ext == ".bc";
+}
+
 // --- Robust Input & Command Execution ---
 int getIntegerInput() {
     int value;
@@ -108,58 +260,35 @@ void parseAndUpdateStats(const std::string& jsonPath, std::map<std::string, long
     std::ifstream jsonFile(jsonPath);
     if (!jsonFile.is_open()) return;
     std::string content((std::istreambuf_iterator<char>(jsonFile)), std::istreambuf_iterator<char>());
-    auto find_and_parse = [&](const std::string& key, const std::string& map_key) {
+    // Keys with skipZero are only reported once they are non-zero.
+    auto find_and_parse = [&](const std::string& key, const std::string& map_key, bool skipZero = false) {
         size_t pos = content.find("\"" + key + "\"");
         if (pos != std::string::npos) {
             size_t colon_pos = content.find(':', pos);
             if (colon_pos != std::string::npos) {
                 try {
-                    statsMap[map_key] += std::stoll(content.substr(colon_pos + 1));
+                    long long value = std::stoll(content.substr(colon_pos + 1));
+                    if (value || !skipZero) statsMap[map_key] += value;
                 } catch (...) { /* ignore parse errors */ }
             }
         }
     };
     find_and_parse("num_strings_encrypted", "Encrypted Strings");
     find_and_parse("total_string_bytes", "Encrypted String Bytes");
+    find_and_parse("num_inline_decryptions", "Inline String Decryptions");
+    find_and_parse("num_runtime_calls_eliminated", "Decrypt Calls Eliminated");
+    find_and_parse("num_bogus_blocks", "Bogus Blocks");
+    find_and_parse("opaque_predicate_cycles", "Opaque Predicate Cycles");
+    find_and_parse("num_fake_loops", "Fake Loops Added");
+    // Estimated from profile data; always 0 without it.
+    find_and_parse("expected_overhead_cycles", "Expected Overhead (cycles)", true);
 }
 
 
-bool runCommand(const std::string& command, const std::string& statsFile, std::map<std::string, long long>& passStats, std::map<std::string, long long>& analysisStats) {
-    const std::string ERR_LOG = "error.log";
+bool runCommand(const std::string& command, const std::string& statsFile, std::map<std::string, long long>& passStats, const std::string& ERR_LOG = "error.log") {
     std::string fullCommand = command + " 2> " + ERR_LOG;
     int result = system(fullCommand.c_str());
 
-    std::ifstream errFile(ERR_LOG);
-    if(errFile.is_open()) {
-        std::string line;
-        while (std::getline(errFile, line)) {
-            if (line.find("Number of instructions") != std::string::npos || line.find("Number of basic blocks") != std::string::npos) {
-                std::stringstream ss(line);
-                long long val;
-                if (ss >> val) {
-                    if (line.find("Number of instructions") != std::string::npos) {
-                        analysisStats["Instruction Count"] = val;
-                    } else if (line.find("Number of basic blocks") != std::string::npos) {
-                        analysisStats["Basic Block Count"] = val;
-                    }
-                }
-            }
-            if (line.find("[BogusInsert] inserted ") != std::string::npos) {
-                long long inserts = 0;
-                if(sscanf(line.c_str(), "[BogusInsert] inserted %lld inserts", &inserts) == 1) {
-                    passStats["Bogus Blocks Inserted"] += inserts;
-                }
-            }
-            else if (line.find("[FakeLoop] inserted ") != std::string::npos) {
-                long long loops = 0;
-                if(sscanf(line.c_str(), "[FakeLoop] inserted %lld loops", &loops) == 1) {
-                    passStats["Fake Loops Added"] += loops;
-                }
-            }
-        }
-        errFile.close();
-    }
-    
     parseAndUpdateStats(statsFile, passStats);
 
     if (result != 0) {
@@ -172,6 +301,37 @@ bool runCommand(const std::string& command, const std::string& statsFile, std::m
     return result == 0;
 }
 
+// Measures M with the metrics API and fills the report rows from it.
+void recordMetrics(const llvm::Module& M, ObfModuleMetrics& metrics, std::map<std::string, long long>& analysis) {
+    metrics = obfModuleMetrics(M);
+    analysis["Instruction Count"] = metrics.Total.Instructions;
+    analysis["Basic Block Count"] = metrics.Total.Blocks;
+    analysis["CFG Edges"] = metrics.Total.Edges;
+    analysis["Calls"] = metrics.Total.Calls;
+    analysis["Allocas"] = metrics.Total.Allocas;
+    analysis["Cyclomatic Complexity"] = metrics.Total.Cyclomatic;
+}
+
+// The shell pipeline keeps its modules in files; load one just to measure it.
+bool recordFileMetrics(const std::string& path, ObfModuleMetrics& metrics, std::map<std::string, long long>& analysis) {
+    llvm::LLVMContext context;
+    llvm::SMDiagnostic err;
+    std::unique_ptr<llvm::Module> module = llvm::parseIRFile(path, err, context);
+    if (!module) {
+        printError("Cannot read " + path + ": " + err.getMessage().str());
+        return false;
+    }
+    recordMetrics(*module, metrics, analysis);
+    return true;
+}
+
+long long irTextSize(const llvm::Module& M) {
+    std::string text;
+    llvm::raw_string_ostream os(text);
+    M.print(os, nullptr);
+    return static_cast<long long>(os.str().size());
+}
+
 // --- Main Obfuscation & UI Logic ---
 ObfuscationResult performObfuscation(const std::string& inputSourceFile, const std::string& outputExecutableName, bool keepIntermediateFiles, ObfuscationConfig& config) {
     ObfuscationResult result;
@@ -181,22 +341,79 @@ ObfuscationResult performObfuscation(const std::string& inputSourceFile, const s
         printInfo("Generated Random Seed", std::to_string(config.seed));
     }
 
-    const std::string PLUGIN_PATH = "./build/libObfPasses.so";
     const std::string RUNTIME_SRC = "./src/runtime/decryptor.c";
     const std::string FINAL_IR_FILENAME = "final_readable_ir.ll";
     const std::string CLANG = "clang-14";
     const std::string OPT = "opt-14";
+    // Intermediates go to a directory of their own, so two runs started in
+    // the same directory do not overwrite each other's files.
+    const std::filesystem::path scratch = makeScratchDir();
+    auto temp = [&](const std::string& name) { return (scratch / name).string(); };
+    const std::string ERR_LOG = temp("error.log");
+    // An .ll/.bc output name stops after obfuscation instead of linking.
+    const bool emitIR = isIRFile(outputExecutableName);
 
-    std::string currentIRFile = "temp_0_initial.ll";
-    std::vector<std::string> tempFiles = {currentIRFile};
+    auto shell = [&](const std::string& command, const std::string& statsFile) {
+        result.processLaunches++;
+        return runCommand(command, statsFile, result.stats, ERR_LOG);
+    };
+
+    // In-process state: the module is parsed once and every pass and cycle
+    // runs on it in memory.
+    llvm::LLVMContext context;
+    std::unique_ptr<llvm::Module> module;
+    std::unique_ptr<llvm::PassPlugin> plugin;
 
     printStep("1: Initial Analysis & Compilation");
     progressBar(5, "Compiling to LLVM IR...");
-    if (!runCommand(CLANG + " -S -emit-llvm " + inputSourceFile + " -o " + currentIRFile, "", result.stats, result.initialAnalysis)) return result;
-    result.initialAnalysis["Code Size (bytes)"] = std::filesystem::file_size(currentIRFile);
-    
+    std::string currentIRFile = inputSourceFile;
+    if (!isIRFile(inputSourceFile)) {
+        StepTimer timer(result, "Frontend (clang)");
+        std::string profileFlag;
+        if (!config.profileFile.empty()) {
+            profileFlag = (config.sampleProfile ? " -fprofile-sample-use=" : " -fprofile-instr-use=") + config.profileFile;
+        }
+        // Bitcode is all the in-process pipeline needs and parses faster.
+        currentIRFile = temp(config.inProcess ? "temp_0_initial.bc" : "temp_0_initial.ll");
+        std::string emit = config.inProcess ? " -c -emit-llvm" : " -S -emit-llvm";
+        if (!shell(CLANG + emit + profileFlag + " " + inputSourceFile + " -o " + currentIRFile, "")) return result;
+    } else if (!config.inProcess) {
+        StepTimer timer(result, "Frontend (opt -S)");
+        currentIRFile = temp("temp_0_initial.ll");
+        if (!shell(OPT + " -S " + inputSourceFile + " -o " + currentIRFile, "")) return result;
+    }
+
     progressBar(10, "Analyzing initial IR...");
-    runCommand(OPT + " -p=instcount,basicaa -stats -S " + currentIRFile + " -o /dev/null", "", result.stats, result.initialAnalysis);
+    if (config.inProcess) {
+        {
+            StepTimer timer(result, "Parse IR");
+            llvm::SMDiagnostic err;
+            module = llvm::parseIRFile(currentIRFile, err, context);
+            if (!module) {
+                std::string message;
+                llvm::raw_string_ostream os(message);
+                err.print("obfuscator", os);
+                printError(os.str());
+                return result;
+            }
+        }
+        {
+            StepTimer timer(result, "Load plugin");
+            auto loaded = llvm::PassPlugin::Load(config.pluginPath);
+            if (!loaded) {
+                printError("Failed to load " + config.pluginPath + ": " + llvm::toString(loaded.takeError()));
+                return result;
+            }
+            plugin = std::make_unique<llvm::PassPlugin>(*loaded);
+        }
+        StepTimer timer(result, "Initial analysis");
+        recordMetrics(*module, result.initialMetrics, result.initialAnalysis);
+        result.initialAnalysis["Code Size (bytes)"] = irTextSize(*module);
+    } else {
+        StepTimer timer(result, "Initial analysis");
+        result.initialAnalysis["Code Size (bytes)"] = std::filesystem::file_size(currentIRFile);
+        if (!recordFileMetrics(currentIRFile, result.initialMetrics, result.initialAnalysis)) return result;
+    }
 
     int totalSteps = (config.stringObfuscation ? config.stringObfCycles : 0) +
                      (config.bogusControlFlow ? config.bogusControlFlowCycles : 0) +
@@ -205,20 +422,94 @@ ObfuscationResult performObfuscation(const std::string& inputSourceFile, const s
     if (totalSteps == 0) totalSteps = 1;
     int currentStep = 0;
 
+    // Scope decrypted strings to the calling function so long-running
+    // programs do not accumulate plaintext copies, unless the user picked a
+    // mode (opt inherits it in the shell pipeline).
     std::stringstream envStream;
     envStream << "LLVM_OBF_SEED=" << config.seed << " LLVM_OBF_BOGUS_RATIO=" << config.bogusControlFlowRatio << " ";
-    
+    if (!std::getenv("LLVM_OBF_STRING_MODE"))
+        envStream << "LLVM_OBF_STRING_MODE=arena ";
+    if (config.inProcess) {
+        setEnv("LLVM_OBF_SEED", std::to_string(config.seed));
+        setEnv("LLVM_OBF_BOGUS_RATIO", std::to_string(config.bogusControlFlowRatio));
+        setEnvDefault("LLVM_OBF_STRING_MODE", "arena");
+    }
+
+    // The key covers everything the passes' output depends on: the input IR,
+    // the pipeline, the pass settings (seed included) and the plugin binary.
+    // A hit replaces the module with the cached result and skips the passes.
+    std::unique_ptr<ObfCache> cache;
+    std::string cacheKey;
+    if (config.inProcess && !config.cacheDir.empty()) {
+        StepTimer timer(result, "Cache lookup");
+        cache = std::make_unique<ObfCache>(config.cacheDir, config.cacheMaxBytes);
+        std::string pipeline;
+        for (const std::string& pass : passPipeline(config)) pipeline += pass + ",";
+        if (config.splitParts) pipeline += "split=" + std::to_string(config.splitParts);
+        cacheKey = ObfCache::key({"obf-bc-1", ObfCache::fileDigest(currentIRFile), pipeline,
+                                  ObfCache::passEnvironment(), ObfCache::fileDigest(config.pluginPath)});
+        std::string cached;
+        if (cache->lookup(cacheKey, cached)) {
+            llvm::SMDiagnostic err;
+            auto hit = llvm::parseIR(llvm::MemoryBufferRef(cached, currentIRFile), err, context);
+            if (hit) {
+                module = std::move(hit);
+                result.cacheResult = "hit";
+            }
+        }
+        if (result.cacheResult.empty()) result.cacheResult = "miss";
+    }
+    const bool cacheHit = result.cacheResult == "hit";
+
+    // One pass, one cycle, on the in-memory module. The passes read their
+    // settings when the pipeline is parsed, so the environment is set first.
+    auto runInProcess = [&](const std::string& flag, int cycle, const std::string& statsFile) -> bool {
+        setEnv("LLVM_OBF_CYCLE", std::to_string(cycle));
+        setEnv("OFILE", statsFile);
+        llvm::PassBuilder builder;
+        plugin->registerPassBuilderCallbacks(builder);
+        llvm::LoopAnalysisManager lam;
+        llvm::FunctionAnalysisManager fam;
+        llvm::CGSCCAnalysisManager cgam;
+        llvm::ModuleAnalysisManager mam;
+        builder.registerModuleAnalyses(mam);
+        builder.registerCGSCCAnalyses(cgam);
+        builder.registerFunctionAnalyses(fam);
+        builder.registerLoopAnalyses(lam);
+        builder.crossRegisterProxies(lam, fam, cgam, mam);
+        llvm::ModulePassManager mpm;
+        if (llvm::Error err = builder.parsePassPipeline(mpm, flag)) {
+            printError("Unknown pass '" + flag + "': " + llvm::toString(std::move(err)));
+            return false;
+        }
+        mpm.run(*module, mam);
+        parseAndUpdateStats(statsFile, result.stats);
+        std::string problems;
+        llvm::raw_string_ostream os(problems);
+        if (llvm::verifyModule(*module, &os)) {
+            std::cerr << Color::BOLD << Color::RED << "\n[DEBUG] " << flag << " produced invalid IR:" << Color::RESET << std::endl;
+            std::cerr << Color::RED << "--- Verifier ---\n" << os.str() << "-----------------" << Color::RESET << std::endl;
+            return false;
+        }
+        return true;
+    };
+
     printStep("2: Applying Obfuscation Passes");
+    const bool split = config.inProcess && config.splitParts && !cacheHit;
     auto applyPass = [&](const std::string& name, const std::string& flag, bool enabled, int cycles) -> bool {
-        if (!enabled) return true;
+        if (!enabled || cacheHit || split) return true;
         for (int i = 0; i < cycles; ++i) {
             currentStep++;
             progressBar(10 + (80 * currentStep / totalSteps), "Applying " + name + " (" + std::to_string(i + 1) + "/" + std::to_string(cycles) + ")");
-            std::string nextIRFile = "temp_" + std::to_string(currentStep) + "_" + flag + ".ll";
-            tempFiles.push_back(nextIRFile);
-            std::string statsFile = "stats_" + std::to_string(currentStep) + ".json";
-            std::string command = envStream.str() + " OFILE=" + statsFile + " " + OPT + " -load-pass-plugin=" + PLUGIN_PATH + " -passes=" + flag + " < " + currentIRFile + " > " + nextIRFile;
-            if (!runCommand(command, statsFile, result.stats, result.finalAnalysis)) return false;
+            StepTimer timer(result, flag + " #" + std::to_string(i + 1));
+            std::string statsFile = temp("stats_" + std::to_string(currentStep) + ".json");
+            if (config.inProcess) {
+                if (!runInProcess(flag, i, statsFile)) return false;
+                continue;
+            }
+            std::string nextIRFile = temp("temp_" + std::to_string(currentStep) + "_" + flag + ".ll");
+            std::string command = envStream.str() + " LLVM_OBF_CYCLE=" + std::to_string(i) + " OFILE=" + statsFile + " " + OPT + " -load-pass-plugin=" + config.pluginPath + " -passes=" + flag + " -S < " + currentIRFile + " > " + nextIRFile;
+            if (!shell(command, statsFile)) return false;
             currentIRFile = nextIRFile;
         }
         return true;
@@ -229,19 +520,99 @@ ObfuscationResult performObfuscation(const std::string& inputSourceFile, const s
     if (!applyPass("Fake Loops", "fake-loop", config.fakeLoops, config.fakeLoopCycles)) return result;
     if (!applyPass("Control Flow Flattening", "cff", config.controlFlowFlattening, config.flatteningCycles)) return result;
 
+    // Every partition runs the whole pipeline at once, so the rounds are
+    // pipeline parameters and OFILE (one file for all threads) is unset.
+    if (split) {
+        progressBar(50, "Applying all passes on " + std::to_string(config.splitParts) + " partitions...");
+        SplitOptions options;
+        options.parts = config.splitParts;
+        options.threads = config.jobs;
+        options.plugin = plugin.get();
+        for (const std::string& pass : passPipeline(config)) options.pipeline += (options.pipeline.empty() ? "" : ",") + pass;
+        unsetEnv("OFILE");
+        SplitReport report;
+        module = runSplit(std::move(module), options, report);
+        result.timings.push_back({"Split module", report.splitMs});
+        result.timings.push_back({"Partitions #" + std::to_string(report.parts) + " on " + std::to_string(report.threads) + " threads", report.runMs});
+        result.timings.push_back({"Link partitions", report.linkMs});
+        result.splitBusyMs = report.busyMs;
+        for (const auto& error : report.errors) printError(error);
+        if (!module) return result;
+        std::string problems;
+        llvm::raw_string_ostream os(problems);
+        if (llvm::verifyModule(*module, &os)) {
+            printError("Linked partitions are invalid: " + os.str());
+            return result;
+        }
+    }
+
+    if (cache && !cacheHit) {
+        StepTimer timer(result, "Cache store");
+        std::string bitcode;
+        llvm::raw_string_ostream os(bitcode);
+        llvm::WriteBitcodeToFile(*module, os);
+        cache->store(cacheKey, os.str());
+        cache->prune();
+        result.cacheEvictions = cache->evictions();
+    }
+
     printStep("3: Finalizing and Linking");
     progressBar(90, "Saving & analyzing final IR...");
-    runCommand("cp " + currentIRFile + " " + FINAL_IR_FILENAME, "", result.stats, result.finalAnalysis);
+    if (config.inProcess) {
+        StepTimer timer(result, "Write final IR");
+        std::error_code ec;
+        llvm::raw_fd_ostream out(FINAL_IR_FILENAME, ec);
+        if (ec) {
+            printError("Cannot write " + FINAL_IR_FILENAME + ": " + ec.message());
+            return result;
+        }
+        module->print(out, nullptr);
+        out.close();
+        recordMetrics(*module, result.finalMetrics, result.finalAnalysis);
+        if (emitIR && std::filesystem::path(outputExecutableName).extension() == ".bc") {
+            llvm::raw_fd_ostream bc(outputExecutableName, ec);
+            if (ec) {
+                printError("Cannot write " + outputExecutableName + ": " + ec.message());
+                return result;
+            }
+            llvm::WriteBitcodeToFile(*module, bc);
+        } else if (emitIR) {
+            std::filesystem::copy_file(FINAL_IR_FILENAME, outputExecutableName, std::filesystem::copy_options::overwrite_existing);
+        }
+    } else {
+        StepTimer timer(result, "Final IR + analysis");
+        shell("cp " + currentIRFile + " " + FINAL_IR_FILENAME, "");
+        if (!recordFileMetrics(FINAL_IR_FILENAME, result.finalMetrics, result.finalAnalysis)) return result;
+        if (emitIR && !shell(OPT + (std::filesystem::path(outputExecutableName).extension() == ".ll" ? " -S " : " ") + FINAL_IR_FILENAME + " -o " + outputExecutableName, "")) return result;
+    }
     result.finalAnalysis["Code Size (bytes)"] = std::filesystem::file_size(FINAL_IR_FILENAME);
-    runCommand(OPT + " -p=instcount,basicaa -stats -S " + FINAL_IR_FILENAME + " -o /dev/null", "", result.stats, result.finalAnalysis);
 
-    progressBar(97, "Compiling & linking executable...");
-    if (!runCommand(CLANG + " " + FINAL_IR_FILENAME + " " + RUNTIME_SRC + " -o " + outputExecutableName, "", result.stats, result.finalAnalysis)) return result;
+    if (!config.metricsFile.empty()) {
+        std::error_code ec;
+        llvm::raw_fd_ostream out(config.metricsFile, ec);
+        if (ec) {
+            printError("Cannot write " + config.metricsFile + ": " + ec.message());
+            return result;
+        }
+        out << "{\n\"before\": ";
+        result.initialMetrics.writeJSON(out);
+        out << ",\n\"after\": ";
+        result.finalMetrics.writeJSON(out);
+        out << "}\n";
+    }
+
+    if (!emitIR) {
+        progressBar(97, "Compiling & linking executable...");
+        StepTimer timer(result, "Link (clang)");
+        if (!shell(CLANG + " " + FINAL_IR_FILENAME + " " + RUNTIME_SRC + " -o " + outputExecutableName, "")) return result;
+    }
     
     if (!keepIntermediateFiles) {
         progressBar(99, "Cleaning up temporary files...");
-        for (const auto& file : tempFiles) runCommand("rm -f " + file, "", result.stats, result.finalAnalysis);
-        runCommand("rm -f stats_*.json error.log", "", result.stats, result.finalAnalysis);
+        std::error_code ignored;
+        std::filesystem::remove_all(scratch, ignored);
+    } else {
+        result.scratchDir = scratch.string();
     }
 
     progressBar(100, "Obfuscation Complete!");
@@ -254,9 +625,24 @@ void displayCurrentSettings(const std::string& inputFile, const ObfuscationConfi
     printInfo("Input Source File", inputFile);
     printInfo("Obfuscation Preset", config.presetName);
     printInfo("Obfuscation Seed", (config.seed == 0 ? "Random" : std::to_string(config.seed)));
+    printInfo("Pass Pipeline", config.inProcess ? "in-process (" + config.pluginPath + ")" : "opt-14 per pass");
+    if (!config.profileFile.empty())
+        printInfo("Profile", config.profileFile + (config.sampleProfile ? " (sampled)" : ""));
     std::cout << "---------------------------------------------------------\n\n";
 }
 
+// Presets 1-4 of the menu; returns false for anything else.
+bool applyPreset(int choice, ObfuscationConfig& config) {
+    switch (choice) {
+        case 1: config.presetName = "Light"; config.stringObfuscation = true; break;
+        case 2: config.presetName = "Balanced"; config.stringObfuscation = true; config.bogusControlFlow = true; config.fakeLoops = true; config.bogusControlFlowRatio=30; break;
+        case 3: config.presetName = "Heavy"; config.stringObfuscation = true; config.stringObfCycles=2; config.bogusControlFlow = true; config.bogusControlFlowCycles=5; config.bogusControlFlowRatio=60; config.fakeLoops = true; config.fakeLoopCycles = 2; break;
+        case 4: config.presetName = "Nightmare"; config.stringObfuscation = true; config.stringObfCycles=2; config.bogusControlFlow = true; config.bogusControlFlowCycles=5; config.controlFlowFlattening = true; config.fakeLoops = true; break;
+        default: return false;
+    }
+    return true;
+}
+
 ObfuscationConfig selectPreset() {
     ObfuscationConfig config;
     printStep("Select Obfuscation Preset");
@@ -270,10 +656,7 @@ ObfuscationConfig selectPreset() {
     choice = getIntegerInput();
     char yn;
     switch (choice) {
-        case 1: config.presetName = "Light"; config.stringObfuscation = true; break;
-        case 2: config.presetName = "Balanced"; config.stringObfuscation = true; config.bogusControlFlow = true; config.fakeLoops = true; config.bogusControlFlowRatio=30; break;
-        case 3: config.presetName = "Heavy"; config.stringObfuscation = true; config.stringObfCycles=2; config.bogusControlFlow = true; config.bogusControlFlowCycles=5; config.bogusControlFlowRatio=60; config.fakeLoops = true; config.fakeLoopCycles = 2; break;
-        case 4: config.presetName = "Nightmare"; config.stringObfuscation = true; config.stringObfCycles=2; config.bogusControlFlow = true; config.bogusControlFlowCycles=5; config.controlFlowFlattening = true; config.fakeLoops = true; break;
+        case 1: case 2: case 3: case 4: applyPreset(choice, config); break;
         case 5:
             config.presetName = "Custom";
             std::cout << "\n--- Custom Settings ---\nEnable String Obfuscation? (y/n): " << Color::BOLD; std::cin >> yn; std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); config.stringObfuscation = (yn == 'y' || yn == 'Y'); std::cout << Color::RESET;
@@ -291,21 +674,263 @@ ObfuscationConfig selectPreset() {
     return config;
 }
 
+void printSummary(ObfuscationResult& result, const std::string& outputName, const ObfuscationConfig& config) {
+    printSuccess("Obfuscation process finished successfully!");
+    std::cout << "\n";
+    printStep("Analysis Comparison");
+    std::cout << Color::BOLD << Color::CYAN << std::left << std::setw(25) << "Metric" << std::setw(15) << "Before" << std::setw(25) << "After" << Color::RESET << "\n";
+    std::cout << "------------------------------------------------------------\n";
+    auto print_analysis_row = [&](const std::string& key, const std::string& display_name) {
+         if (result.initialAnalysis.count(key) && result.finalAnalysis.count(key)) {
+             long long initialVal = result.initialAnalysis[key];
+             long long finalVal = result.finalAnalysis[key];
+             long long change = finalVal - initialVal;
+             std::stringstream afterSS;
+             afterSS << finalVal;
+             if (change != 0) {
+                 double pct_change = (initialVal == 0) ? 100.0 : (double)change / initialVal * 100.0;
+                 afterSS << " (" << (change > 0 ? "+" : "") << change << " | " 
+                         << (change > 0 ? "+" : "") << std::fixed << std::setprecision(1) << pct_change << "%)";
+             }
+              std::cout << Color::CYAN << std::left << std::setw(25) << display_name << Color::RESET 
+                        << std::left << std::setw(15) << initialVal 
+                        << std::left << std::setw(25) << afterSS.str() << "\n";
+         }
+    };
+    print_analysis_row("Instruction Count", "Instruction Count");
+    print_analysis_row("Basic Block Count", "Basic Block Count");
+    print_analysis_row("CFG Edges", "CFG Edges");
+    print_analysis_row("Cyclomatic Complexity", "Cyclomatic Complexity");
+    print_analysis_row("Calls", "Calls");
+    print_analysis_row("Allocas", "Allocas");
+    print_analysis_row("Code Size (bytes)", "Code Size (bytes)");
+    printStep("Obfuscation Statistics (Changes Made)");
+    if (result.cacheResult == "hit") {
+        std::cout << "  Result taken from the cache; the passes did not run.\n";
+    } else if (result.stats.empty()) {
+        std::cout << "  No specific statistics were reported by the passes.\n";
+    } else {
+        for(const auto& pair : result.stats) {
+            printInfo("  " + pair.first, std::to_string(pair.second));
+        }
+    }
+    printStep(std::string("Timing Breakdown (") + (config.inProcess ? "in-process" : "opt per pass") + ")");
+    double total = 0, passTotal = 0;
+    for (const auto& step : result.timings) {
+        std::stringstream ms;
+        ms << std::fixed << std::setprecision(1) << step.second << " ms";
+        printInfo("  " + step.first, ms.str());
+        total += step.second;
+        if (step.first.find(" #") != std::string::npos) passTotal += step.second;
+    }
+    std::stringstream totals;
+    totals << std::fixed << std::setprecision(1) << passTotal << " ms of " << total << " ms, " << result.processLaunches << " processes launched";
+    printInfo("  Passes Total", totals.str());
+    if (result.splitBusyMs > 0) {
+        std::stringstream busy;
+        busy << std::fixed << std::setprecision(1) << result.splitBusyMs << " ms summed over partitions";
+        printInfo("  Partition Busy Time", busy.str());
+    }
+    if (!result.cacheResult.empty())
+        printInfo("  Cache", result.cacheResult + " (" + config.cacheDir + ", " + std::to_string(result.cacheEvictions) + " evicted)");
+    printStep("Output Files (Absolute Paths)");
+    std::filesystem::path currentPath = std::filesystem::current_path();
+    if (isIRFile(outputName)) {
+        printInfo("  Obfuscated IR", (currentPath / outputName).string());
+    } else {
+        printInfo("  Executable", (currentPath / outputName).string());
+        printInfo("  To Run Executable", "./" + outputName);
+    }
+    printInfo("  Final Readable LLVM IR", (currentPath / "final_readable_ir.ll").string());
+    if (!result.scratchDir.empty())
+        printInfo("  Intermediate Files", result.scratchDir);
+}
+
+void printFailure() {
+    std::cout << "\n\n" << Color::BOLD << Color::RED;
+    std::cout << "=========================================================\n";
+    std::cout << "                      Obfuscation Failed                 \n";
+    std::cout << "=========================================================\n\n" << Color::RESET;
+    printError("The process encountered an error. Please review the [DEBUG] logs above for details.");
+}
+
+// `--batch compile_commands.json`: every TU of the database goes through the
+// configured passes on a work-stealing pool (tools/obf_batch.h).
+int runBatchMode(const std::string& database, ObfuscationConfig& config, const std::string& outDir) {
+    if (config.seed == 0) {
+        std::random_device rd;
+        config.seed = rd();
+        printInfo("Generated Random Seed", std::to_string(config.seed));
+    }
+    BatchOptions options;
+    options.compileCommands = database;
+    options.outDir = outDir;
+    options.pluginPath = config.pluginPath;
+    options.threads = config.jobs;
+    if (!config.profileFile.empty())
+        options.extraCompileFlags = (config.sampleProfile ? "-fprofile-sample-use=" : "-fprofile-instr-use=") + config.profileFile;
+    options.passes = passPipeline(config);
+    std::unique_ptr<ObfCache> cache;
+    if (!config.cacheDir.empty()) {
+        cache = std::make_unique<ObfCache>(config.cacheDir, config.cacheMaxBytes);
+        options.cache = cache.get();
+    }
+
+    // The jobs share the environment, so it is set once before they start and
+    // the rounds travel as pass parameters. OFILE would be one file for all.
+    setEnv("LLVM_OBF_SEED", std::to_string(config.seed));
+    setEnv("LLVM_OBF_BOGUS_RATIO", std::to_string(config.bogusControlFlowRatio));
+    setEnvDefault("LLVM_OBF_STRING_MODE", "arena");
+    unsetEnv("OFILE");
+
+    printStep("Batch Obfuscation");
+    printInfo("Compilation Database", database);
+    printInfo("Obfuscation Preset", config.presetName);
+    printInfo("Obfuscation Seed", std::to_string(config.seed));
+    printInfo("Output Directory", outDir);
+    std::error_code ec;
+    std::filesystem::create_directories(outDir, ec);
+    const std::string passLog = (std::filesystem::path(outDir) / "passes.log").string();
+
+    BatchReport report;
+    bool started;
+    {
+        // The passes log from every worker at once; keep that off the terminal.
+        StderrToFile capture(passLog);
+        started = runBatch(options, report);
+    }
+    for (const auto& error : report.errors) printError(error);
+    if (!started) return 1;
+
+    printStep("Batch Summary");
+    std::stringstream line;
+    line << std::fixed << std::setprecision(2);
+    printInfo("Translation Units", std::to_string(report.units) + " (" + std::to_string(report.failed) + " failed)");
+    line << report.wallMs / 1000.0 << " s on " << report.threads << " threads (" << report.steals << " steals)";
+    printInfo("Wall Time", line.str());
+    line.str("");
+    line << (report.wallMs > 0 ? report.units * 1000.0 / report.wallMs : 0.0) << " TU/s";
+    printInfo("Throughput", line.str());
+    for (const auto& stage : report.stages) {
+        double utilization = report.wallMs > 0 ? 100.0 * stage.busyMs / (report.wallMs * report.threads) : 0.0;
+        line.str("");
+        line << stage.tasks << " tasks, " << stage.busyMs << " ms busy, " << std::setprecision(1) << utilization << "% utilization" << std::setprecision(2);
+        printInfo("  Stage " + stage.name, line.str());
+    }
+    if (cache) {
+        cache->prune();
+        line.str("");
+        line << cache->hits() << " hits, " << cache->misses() << " misses, " << cache->stores() << " stored, " << cache->evictions() << " evicted";
+        printInfo("Cache", line.str());
+    }
+    printInfo("Pass Log", passLog);
+    return report.failed ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         printHeader("SIH LLVM Obfuscator");
-        printError("Usage: ./<executable_name> <initial_source_file.c/.cpp>");
+        printError("Usage: ./<executable_name> <initial_source_file.c/.cpp/.ll/.bc> [--profile <file.profdata> | --sample-profile <file>]\n"
+                   "         [--pipeline inproc|shell] [--plugin <libObfPasses.so>] [--metrics <file.json>]\n"
+                   "         [--preset Light|Balanced|Heavy|Nightmare] [--seed <n>] [--output <file>]\n"
+                   "         [--cache <dir>] [--cache-size <MiB>] [--split <parts>] [--jobs <n>]\n"
+                   "       ./<executable_name> --batch <compile_commands.json> [--jobs <n>] [--out-dir <dir>] [options]");
         printInfo("Example", "./build/tools/LLVM_OBFSCALTION.exe tests/hello.c");
+        printInfo("Non-interactive", "--output runs once and exits; an .ll/.bc name skips linking");
         return 1;
     }
 
-    std::string currentInputFile = argv[1];
+    const bool batch = std::string(argv[1]) == "--batch";
+    if (batch && argc < 3) {
+        printError("Missing value for --batch");
+        return 1;
+    }
+    std::string currentInputFile = argv[batch ? 2 : 1];
     ObfuscationConfig currentConfig;
     currentConfig.presetName = "Balanced";
     currentConfig.stringObfuscation = true;
     currentConfig.bogusControlFlow = true;
     currentConfig.fakeLoops = true;
     currentConfig.bogusControlFlowRatio = 30;
+    std::string outputName;
+    std::string outDir = "obf-out";
+    for (int i = batch ? 3 : 2; i < argc; i += 2) {
+        std::string opt = argv[i];
+        if (i + 1 >= argc) {
+            printError("Missing value for " + opt);
+            return 1;
+        }
+        std::string value = argv[i + 1];
+        if (opt == "--profile" || opt == "--sample-profile") {
+            currentConfig.profileFile = value;
+            currentConfig.sampleProfile = opt == "--sample-profile";
+        } else if (opt == "--pipeline" && (value == "inproc" || value == "shell")) {
+            currentConfig.inProcess = value == "inproc";
+        } else if (opt == "--plugin") {
+            currentConfig.pluginPath = value;
+        } else if (opt == "--preset") {
+            const char* names[] = {"Light", "Balanced", "Heavy", "Nightmare"};
+            int choice = 0;
+            for (int p = 0; p < 4; ++p) if (value == names[p]) choice = p + 1;
+            ObfuscationConfig preset;
+            if (!applyPreset(choice, preset)) {
+                printError("Unknown preset: " + value);
+                return 1;
+            }
+            preset.profileFile = currentConfig.profileFile;
+            preset.sampleProfile = currentConfig.sampleProfile;
+            preset.inProcess = currentConfig.inProcess;
+            preset.pluginPath = currentConfig.pluginPath;
+            preset.metricsFile = currentConfig.metricsFile;
+            preset.cacheDir = currentConfig.cacheDir;
+            preset.cacheMaxBytes = currentConfig.cacheMaxBytes;
+            preset.jobs = currentConfig.jobs;
+            preset.splitParts = currentConfig.splitParts;
+            preset.seed = currentConfig.seed;
+            currentConfig = preset;
+        } else if (opt == "--seed") {
+            currentConfig.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (opt == "--metrics") {
+            currentConfig.metricsFile = value;
+        } else if (opt == "--output") {
+            outputName = value;
+        } else if (opt == "--cache") {
+            currentConfig.cacheDir = value;
+        } else if (opt == "--cache-size") {
+            currentConfig.cacheMaxBytes = std::strtoull(value.c_str(), nullptr, 10) << 20;
+        } else if (opt == "--jobs") {
+            currentConfig.jobs = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (opt == "--split") {
+            currentConfig.splitParts = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (opt == "--out-dir") {
+            outDir = value;
+        } else {
+            printError("Unknown option: " + opt + " " + value);
+            return 1;
+        }
+    }
+    // The cache and module splitting work on the in-memory module.
+    if (!batch && !currentConfig.inProcess && (!currentConfig.cacheDir.empty() || currentConfig.splitParts)) {
+        printError(std::string(currentConfig.cacheDir.empty() ? "--split" : "--cache") +
+                   " needs the in-process pipeline; drop --pipeline shell");
+        return 1;
+    }
+    // Options given on the command line survive a preset change in the menu.
+    const ObfuscationConfig sessionConfig = currentConfig;
+
+    if (batch) return runBatchMode(currentInputFile, currentConfig, outDir);
+
+    if (!outputName.empty()) {
+        displayCurrentSettings(currentInputFile, currentConfig);
+        ObfuscationResult result = performObfuscation(currentInputFile, outputName, false, currentConfig);
+        std::cout << "\n";
+        if (!result.success) {
+            printFailure();
+            return 1;
+        }
+        printSummary(result, outputName, currentConfig);
+        return 0;
+    }
 
     while (true) {
         printHeader("SIH LLVM Obfuscator");
@@ -335,7 +960,18 @@ int main(int argc, char *argv[]) {
                 std::cout << "\nPress Enter to continue..."; std::cin.get();
                 break;
             }
-            case 2: currentConfig = selectPreset(); std::cout << "\nPress Enter to continue..."; std::cin.get(); break;
+            case 2:
+                currentConfig = selectPreset();
+                currentConfig.profileFile = sessionConfig.profileFile;
+                currentConfig.sampleProfile = sessionConfig.sampleProfile;
+                currentConfig.inProcess = sessionConfig.inProcess;
+                currentConfig.pluginPath = sessionConfig.pluginPath;
+                currentConfig.metricsFile = sessionConfig.metricsFile;
+                currentConfig.cacheDir = sessionConfig.cacheDir;
+                currentConfig.cacheMaxBytes = sessionConfig.cacheMaxBytes;
+                currentConfig.jobs = sessionConfig.jobs;
+                currentConfig.splitParts = sessionConfig.splitParts;
+                std::cout << "\nPress Enter to continue..."; std::cin.get(); break;
             case 3: {
                 printStep("Set Obfuscation Seed");
                 std::cout << "Enter seed (a number, or 0 for random): " << Color::BOLD;
@@ -361,50 +997,9 @@ int main(int argc, char *argv[]) {
                 
                 if (result.success) {
                     printHeader("Obfuscation Summary");
-                    printSuccess("Obfuscation process finished successfully!");
-                    std::cout << "\n";
-                    printStep("Analysis Comparison");
-                    std::cout << Color::BOLD << Color::CYAN << std::left << std::setw(25) << "Metric" << std::setw(15) << "Before" << std::setw(25) << "After" << Color::RESET << "\n";
-                    std::cout << "------------------------------------------------------------\n";
-                    auto print_analysis_row = [&](const std::string& key, const std::string& display_name) {
-                         if (result.initialAnalysis.count(key) && result.finalAnalysis.count(key)) {
-                             long long initialVal = result.initialAnalysis[key];
-                             long long finalVal = result.finalAnalysis[key];
-                             long long change = finalVal - initialVal;
-                             std::stringstream afterSS;
-                             afterSS << finalVal;
-                             if (change != 0) {
-                                 double pct_change = (initialVal == 0) ? 100.0 : (double)change / initialVal * 100.0;
-                                 afterSS << " (" << (change > 0 ? "+" : "") << change << " | " 
-                                         << (change > 0 ? "+" : "") << std::fixed << std::setprecision(1) << pct_change << "%)";
-                             }
-                              std::cout << Color::CYAN << std::left << std::setw(25) << display_name << Color::RESET 
-                                        << std::left << std::setw(15) << initialVal 
-                                        << std::left << std::setw(25) << afterSS.str() << "\n";
-                         }
-                    };
-                    print_analysis_row("Instruction Count", "Instruction Count");
-                    print_analysis_row("Basic Block Count", "Basic Block Count");
-                    print_analysis_row("Code Size (bytes)", "Code Size (bytes)");
-                    printStep("Obfuscation Statistics (Changes Made)");
-                    if (result.stats.empty()) {
-                        std::cout << "  No specific statistics were reported by the passes.\n";
-                    } else {
-                        for(const auto& pair : result.stats) {
-                            printInfo("  " + pair.first, std::to_string(pair.second));
-                        }
-                    }
-                    printStep("Output Files (Absolute Paths)");
-                    std::filesystem::path currentPath = std::filesystem::current_path();
-                    printInfo("  Executable", (currentPath / outputExeName).string());
-                    printInfo("  To Run Executable", "./" + outputExeName);
-                    printInfo("  Final Readable LLVM IR", (currentPath / "final_readable_ir.ll").string());
+                    printSummary(result, outputExeName, currentConfig);
                 } else {
-                    std::cout << "\n\n" << Color::BOLD << Color::RED;
-                    std::cout << "=========================================================\n";
-                    std::cout << "                      Obfuscation Failed                 \n";
-                    std::cout << "=========================================================\n\n" << Color::RESET;
-                    printError("The process encountered an error. Please review the [DEBUG] logs above for details.");
+                    printFailure();
                 }
                 std::cout << "\nPress Enter to return to the main menu...";
                 std::cin.get();